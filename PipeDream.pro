@@ -8,22 +8,54 @@ CONFIG += c++17
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# 粒子运行状态默认单精度，qmake CONFIG+=particle_double 切换为双精度
+particle_double: DEFINES += PARTICLE_DOUBLE_PRECISION
+
 SOURCES += \
     affector.cpp \
+    audioanalyzer.cpp \
+    barneshut.cpp \
+    emissionshape.cpp \
     emitter.cpp \
+    flowfield.cpp \
+    framedriver.cpp \
     graphicsitems.cpp \
+    lifetimelut.cpp \
     main.cpp \
     pipedream.cpp \
+    scheduler.cpp \
     screenwriter.cpp \
-    sequencer.cpp
+    sequencer.cpp \
+    shapefield.cpp \
+    showstats.cpp \
+    simrandom.cpp \
+    spatialhash.cpp \
+    splat.cpp \
+    synclatency.cpp \
+    transition.cpp
 
 HEADERS += \
     affector.h \
+    audioanalyzer.h \
+    barneshut.h \
+    emissionshape.h \
     emitter.h \
+    flowfield.h \
+    framedriver.h \
     graphicsitems.h \
+    lifetimelut.h \
     pipedream.h \
+    scheduler.h \
     screenwriter.h \
-    sequencer.h
+    sequencer.h \
+    shapefield.h \
+    showstats.h \
+    simrandom.h \
+    spatialhash.h \
+    splat.h \
+    synclatency.h \
+    transition.h \
+    triplebuffer.h
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -1,6 +1,7 @@
 #include "affector.h"
 #include "graphicsitems.h"
-#include <QRandomGenerator>
+#include "simrandom.h"
+#include <QtMath>
 
 //粒子力场干扰(施加固定的力值对粒子的速度进行干扰)
 void ForceAffector::affect(QGraphicsObject *item)
@@ -11,9 +12,7 @@ void ForceAffector::affect(QGraphicsObject *item)
         {
             return;
         }
-        auto params = particle->params();
-        params.velocity += m_force;
-        particle->setParams(params);
+        particle->accelerate(m_force);
     }
 }
 
@@ -26,13 +25,158 @@ void TurbulenceAffector::affect(QGraphicsObject *item)
         {
             return;
         }
-        auto params = particle->params();
-        params.velocity += QVector2D(-0.1 + QRandomGenerator::global()->bounded(0.2), -0.1 + QRandomGenerator::global()->bounded(0.2));
-        particle->setParams(params);
+        particle->accelerate(QVector2D(-0.1 + SimRandom::global()->bounded(0.2), -0.1 + SimRandom::global()->bounded(0.2)));
     }
 }
 
+void FlowFieldAffector::prepare(const QList<Particle *> &particles)
+{
+    Q_UNUSED(particles)
+    const int frames = m_field->frames();
+    m_time = std::fmod(m_time + m_timeScale, qreal(frames));
+
+    //在相邻两帧间插值出本帧切片
+    const int f0 = int(m_time);
+    const int f1 = (f0 + 1) % frames;
+    const float t = float(m_time - f0);
+    const int count = m_field->size() * m_field->size();
+    const QVector2D *frame0 = m_field->frame(f0);
+    const QVector2D *frame1 = m_field->frame(f1);
+    m_slice.resize(count);
+    for (int i = 0; i < count; ++i) {
+        m_slice[i] = (frame0[i] + (frame1[i] - frame0[i]) * t) * m_strength;
+    }
+}
 
+//流场平移(一次查表，网格尺寸为2的幂，取模用位与实现平铺)
+void FlowFieldAffector::affect(QGraphicsObject *item)
+{
+    if (Particle *particle = dynamic_cast<Particle*>(item))
+    {
+        const QPointF pos = particle->pos();
+        if(!isInside(pos) || m_slice.isEmpty())
+        {
+            return;
+        }
+        const int mask = m_field->size() - 1;
+        const int x = qFloor(pos.x() / m_cellSize) & mask;
+        const int y = qFloor(pos.y() / m_cellSize) & mask;
+        particle->shiftCenter(m_slice.at(y * m_field->size() + x));
+    }
+}
+
+//每帧用粒子位置与速度的快照重建空间哈希，保证同一帧内所有粒子看到一致的邻居状态
+void FlockingAffector::prepare(const QList<Particle *> &particles)
+{
+    m_entries.clear();
+    m_entries.reserve(particles.count());
+    for (Particle *particle : particles) {
+        const QPointF pos = particle->pos();
+        if(isInside(pos))
+        {
+            m_entries.append({pos, particle->velocity(), particle});
+        }
+    }
+    m_hash.build(m_entries);
+}
+
+void FlockingAffector::affect(QGraphicsObject *item)
+{
+    if (Particle *particle = dynamic_cast<Particle*>(item))
+    {
+        const QPointF pos = particle->pos();
+        if(!isInside(pos))
+        {
+            return;
+        }
+
+        QVector2D separation;
+        QVector2D velocitySum;
+        QPointF positionSum;
+        int neighbours = 0;
+        m_hash.query(pos, m_radius, [&](const SpatialHash::Entry &entry) {
+            if(entry.key == particle)
+            {
+                return true;
+            }
+            const QVector2D offset(pos - entry.position);
+            const float distance2 = offset.lengthSquared();
+            if(distance2 > 1e-6f)
+            {
+                separation += offset / distance2 * float(m_radius);     //越近排斥越强
+            }
+            velocitySum += entry.velocity;
+            positionSum += entry.position;
+            return ++neighbours < m_maxNeighbours;
+        });
+        if(neighbours == 0)
+        {
+            return;
+        }
+
+        QVector2D velocity = particle->velocity();
+        const QVector2D averageVelocity = velocitySum / neighbours;
+        const QVector2D toCenter(positionSum / neighbours - pos);
+        velocity += separation * m_separation
+                  + (averageVelocity - velocity) * m_alignment
+                  + toCenter * m_cohesion;
+        if(velocity.length() > m_maxSpeed)
+        {
+            velocity = velocity.normalized() * m_maxSpeed;
+        }
+        particle->setVelocity(velocity);
+    }
+}
+
+void AttractorAffector::addSource(const QPointF &position, qreal mass, qreal spin)
+{
+    m_fixed.append({position, float(mass), float(spin), nullptr});
+}
+
+void AttractorAffector::setParticleSources(const Emitter *emitter, qreal mass, qreal spin)
+{
+    m_particleSources = mass != 0 || spin != 0;
+    m_sourceEmitter = emitter;
+    m_particleMass = float(mass);
+    m_particleSpin = float(spin);
+}
+
+//每帧用固定源与粒子位置的快照重建四叉树，保证同一帧内所有粒子感受到一致的场
+void AttractorAffector::prepare(const QList<Particle *> &particles)
+{
+    m_sources = m_fixed;
+    if(m_particleSources)
+    {
+        m_sources.reserve(m_fixed.count() + particles.count());
+        for (Particle *particle : particles) {
+            if(!m_sourceEmitter || particle->emitter() == m_sourceEmitter)
+            {
+                m_sources.append({particle->pos(), m_particleMass, m_particleSpin, particle});
+            }
+        }
+    }
+    m_tree.build(m_sources);
+}
+
+//引力与涡旋(自身作为源时排除自身)，单帧速度变化限制在m_maxAcceleration内
+void AttractorAffector::affect(QGraphicsObject *item)
+{
+    if (Particle *particle = dynamic_cast<Particle*>(item))
+    {
+        const QPointF pos = particle->pos();
+        if(!isInside(pos) || m_tree.count() == 0)
+        {
+            return;
+        }
+        QVector2D acceleration = m_tree.field(pos, particle);
+        const float length = acceleration.length();
+        if(length > m_maxAcceleration)
+        {
+            acceleration *= float(m_maxAcceleration) / length;
+        }
+        particle->accelerate(acceleration);
+    }
+}
 
 
 // void HeartShapeAffector::affect(QGraphicsObject *item)
@@ -83,51 +227,62 @@ void TurbulenceAffector::affect(QGraphicsObject *item)
 //     return (temp * temp * temp - x2 * y2 * y) <= 0;
 // }
 
-void HeartRepelAffector::affect(QGraphicsObject *item)
+bool ShapeFieldAffector::sampleField(const QPointF &pos, qreal *distance, QVector2D *gradient) const
 {
-    if (Particle* particle = dynamic_cast<Particle*>(item))
+    if(!m_range.contains(pos) || !m_field->bounds().contains(pos))
     {
-        const QPointF pos = particle->pos();
-        const qreal distance = distanceToHeartEdge(pos);
+        return false;
+    }
+    return m_field->sample(pos, distance, gradient);
+}
 
-        // 在影响范围内施加排斥力
-        if (distance < m_repelRange)
+void ShapeRepelAffector::affect(QGraphicsObject *item)
+{
+    if (Particle* particle = dynamic_cast<Particle*>(item))
+    {
+        qreal distance;
+        QVector2D gradient;
+        if(!sampleField(particle->pos(), &distance, &gradient) || distance >= m_falloff)
         {
-            const QVector2D repelDir = calculateRepelDirection(pos);
-            const qreal strength = (m_repelRange - distance) / m_repelRange;
-
-            auto params = particle->params();
-            params.velocity += repelDir * strength * m_repelForce;
-            particle->setParams(params);
+            return;
         }
+
+        // 越靠近边缘(或越深入形状内部)排斥力越强
+        const qreal strength = std::min((m_falloff - distance) / m_falloff, 2.0);
+        particle->accelerate(gradient * strength * m_force);
     }
 }
 
-qreal HeartRepelAffector::distanceToHeartEdge(const QPointF &pos) const
+void ShapeAttractAffector::affect(QGraphicsObject *item)
 {
-    const qreal x = (pos.x() - m_center.x()) / m_scale;
-    const qreal y = (pos.y() - m_center.y()) / m_scale;
-
-    // 心形隐式方程：(x² + y² - 1)³ - x²y³ = 0
-    const qreal x2 = x * x;
-    const qreal y2 = y * y;
-    const qreal temp = x2 + y2 - 1.0;
-    const qreal heartValue = temp * temp * temp - x2 * y2 * y;
+    if (Particle* particle = dynamic_cast<Particle*>(item))
+    {
+        qreal distance;
+        QVector2D gradient;
+        if(!sampleField(particle->pos(), &distance, &gradient) || distance <= 0 || distance >= m_falloff)
+        {
+            return;
+        }
 
-    // 近似距离（符号表示内外）
-    return heartValue / (x2 + y2 + 1e-6);
+        const qreal strength = distance / m_falloff;
+        particle->accelerate(-gradient * strength * m_force);
+    }
 }
 
-QVector2D HeartRepelAffector::calculateRepelDirection(const QPointF &pos) const
+void ShapeContainAffector::affect(QGraphicsObject *item)
 {
-    const qreal epsilon = 1e-3;
-    const qreal dx = distanceToHeartEdge(pos + QPointF(epsilon, 0)) -
-                     distanceToHeartEdge(pos - QPointF(epsilon, 0));
-    const qreal dy = distanceToHeartEdge(pos + QPointF(0, epsilon)) -
-                     distanceToHeartEdge(pos - QPointF(0, epsilon));
-
-    QVector2D gradient(dx, dy);
-    return gradient / (gradient.toPointF().manhattanLength() + 1e-6);
+    if (Particle* particle = dynamic_cast<Particle*>(item))
+    {
+        qreal distance;
+        QVector2D gradient;
+        if(!sampleField(particle->pos(), &distance, &gradient) || distance <= -m_falloff)
+        {
+            return;
+        }
+
+        const qreal strength = std::min((distance + m_falloff) / m_falloff, 2.0);
+        particle->accelerate(-gradient * strength * m_force);
+    }
 }
 
 void AmplitudeAffector::affect(QGraphicsObject *item)
@@ -2,17 +2,27 @@
 #define AFFECTOR_H
 
 #include <QGraphicsObject>
+#include <QDataStream>
 #include <QVector2D>
 #include <QPointF>
+#include <QSharedPointer>
+#include "shapefield.h"
+#include "flowfield.h"
+#include "spatialhash.h"
+#include "barneshut.h"
 
 class Particle;
+class Emitter;
 
 //干扰器基类
 class Affector : public QObject
 {
 public:
     Affector(const QRectF &range) : m_range(range){}
+    virtual void prepare(const QList<Particle*> &particles){Q_UNUSED(particles)}  //每帧作用前调用一次，用于构建本帧共享数据
     virtual void affect(QGraphicsObject *item) = 0;
+    virtual void saveState(QDataStream &out) const {Q_UNUSED(out)}           //跨帧保存的状态(用于快照)，每帧在prepare中重建的数据不需要保存
+    virtual void restoreState(QDataStream &in){Q_UNUSED(in)}
 protected:
     bool isInside(const QPointF &p){return m_range.contains(p);}
     QRectF m_range;
@@ -36,6 +46,69 @@ public:
     void affect(QGraphicsObject *item) override;
 };
 
+//流场干扰器：按粒子位置查表(预计算的旋度噪声流场)平移粒子，每帧只在时间维上插值一次当前切片
+class FlowFieldAffector : public Affector
+{
+public:
+    FlowFieldAffector(const QRectF &range, const QSharedPointer<const FlowField> &field, qreal cellSize = 20.0, qreal strength = 1.0, qreal timeScale = 0.05)
+        : Affector(range), m_field(field), m_cellSize(cellSize), m_strength(strength), m_timeScale(timeScale) {}
+    void prepare(const QList<Particle*> &particles) override;
+    void affect(QGraphicsObject *item) override;
+    void saveState(QDataStream &out) const override {out << m_time;}
+    void restoreState(QDataStream &in) override {in >> m_time;}
+private:
+    QSharedPointer<const FlowField> m_field;
+    qreal m_cellSize;               //流场格子对应的场景尺寸
+    qreal m_strength;               //最大位移(像素/帧)
+    qreal m_timeScale;              //每帧推进的流场帧数
+    qreal m_time = 0;
+    QVector<QVector2D> m_slice;     //当前帧的流场切片(已乘以强度)
+};
+
+//群聚干扰器(分离、对齐、聚合)，邻域查询通过每帧重建的空间哈希完成
+class FlockingAffector : public Affector
+{
+public:
+    FlockingAffector(const QRectF &range, qreal radius = 40.0, qreal separation = 0.05, qreal alignment = 0.03, qreal cohesion = 0.005, qreal maxSpeed = 5.0)
+        : Affector(range), m_hash(radius), m_radius(radius), m_separation(separation), m_alignment(alignment), m_cohesion(cohesion), m_maxSpeed(maxSpeed) {}
+    void prepare(const QList<Particle*> &particles) override;
+    void affect(QGraphicsObject *item) override;
+    void setMaxNeighbours(int count){m_maxNeighbours = count;}
+private:
+    SpatialHash m_hash;
+    QVector<SpatialHash::Entry> m_entries;
+    qreal m_radius;                 //感知半径
+    qreal m_separation;             //分离权重
+    qreal m_alignment;              //对齐权重
+    qreal m_cohesion;               //聚合权重
+    qreal m_maxSpeed;               //最大速度
+    int m_maxNeighbours = 16;       //每个粒子最多参考的邻居数
+};
+
+//引力/涡旋场干扰器(引力井、吸引点、排斥点、漩涡)
+//固定源与粒子源每帧汇总到Barnes–Hut四叉树，数百个源作用于数千个粒子时仍是O(n·log m)
+class AttractorAffector : public Affector
+{
+public:
+    AttractorAffector(const QRectF &range, qreal theta = 0.5, qreal softening = 20.0, qreal maxAcceleration = 1.0)
+        : Affector(range), m_tree(theta, softening), m_maxAcceleration(maxAcceleration) {}
+    void prepare(const QList<Particle*> &particles) override;
+    void affect(QGraphicsObject *item) override;
+
+    void addSource(const QPointF &position, qreal mass, qreal spin = 0.0);      //mass>0吸引、<0排斥，spin>0顺时针涡旋
+    void setParticleSources(const Emitter *emitter, qreal mass, qreal spin = 0.0); //该发射器的粒子(nullptr为所有粒子)也作为源
+    void setAccuracy(qreal theta){m_tree.setTheta(theta);}                      //0为精确求和，默认0.5
+private:
+    BarnesHut m_tree;
+    QVector<BarnesHut::Source> m_fixed;     //固定源
+    QVector<BarnesHut::Source> m_sources;   //本帧的全部源
+    bool m_particleSources = false;
+    const Emitter *m_sourceEmitter = nullptr;
+    float m_particleMass = 0;
+    float m_particleSpin = 0;
+    qreal m_maxAcceleration;                //单帧速度变化上限(避免近距离时速度爆发)
+};
+
 //粒子振幅衰减干扰器
 class AmplitudeAffector : public Affector
 {
@@ -74,25 +147,52 @@ private:
 // };
 
 
-class HeartRepelAffector : public Affector
+//形状场干扰器基类(基于预烘焙的有向距离场，m_falloff为形状边缘外的作用范围)
+class ShapeFieldAffector : public Affector
 {
 public:
-    HeartRepelAffector(const QRectF &range ,QPointF center, qreal scale, qreal repelForce = 1.0)
-        :Affector(range), m_center(center), m_scale(scale), m_repelForce(repelForce) {}
+    ShapeFieldAffector(const QRectF &range, const QSharedPointer<const ShapeField> &field, qreal force = 1.0, qreal falloff = 50.0)
+        : Affector(range), m_field(field), m_force(force), m_falloff(falloff) {}
 
-    void affect(QGraphicsObject* item) override;
+protected:
+    //采样粒子所在位置的距离与梯度，范围外(干扰范围或场范围)直接剔除
+    bool sampleField(const QPointF &pos, qreal *distance, QVector2D *gradient) const;
 
-private:
-    // 计算点到心形边缘的最近距离
-    qreal distanceToHeartEdge(const QPointF& pos) const;
+    QSharedPointer<const ShapeField> m_field;
+    qreal m_force;          //力强度
+    qreal m_falloff;        //作用范围
+};
 
-    // 计算排斥方向（指向最近的心形边缘）
-    QVector2D calculateRepelDirection(const QPointF& pos) const;
+//形状排斥干扰器：将边缘附近及形状内部的粒子推向形状外
+class ShapeRepelAffector : public ShapeFieldAffector
+{
+public:
+    using ShapeFieldAffector::ShapeFieldAffector;
+    void affect(QGraphicsObject *item) override;
+};
 
-    QPointF m_center;    // 心形中心
-    qreal m_scale;       // 缩放系数
-    qreal m_repelForce;  // 排斥力强度
-    qreal m_repelRange = 50.0; // 排斥作用范围
+//形状吸引干扰器：将形状外作用范围内的粒子拉向形状边缘
+class ShapeAttractAffector : public ShapeFieldAffector
+{
+public:
+    using ShapeFieldAffector::ShapeFieldAffector;
+    void affect(QGraphicsObject *item) override;
+};
+
+//形状约束干扰器：将形状内靠近边缘及已越界的粒子推回形状内
+class ShapeContainAffector : public ShapeFieldAffector
+{
+public:
+    using ShapeFieldAffector::ShapeFieldAffector;
+    void affect(QGraphicsObject *item) override;
+};
+
+//心形排斥干扰器
+class HeartRepelAffector : public ShapeRepelAffector
+{
+public:
+    HeartRepelAffector(const QRectF &range ,QPointF center, qreal scale, qreal repelForce = 1.0, qreal repelRange = 50.0)
+        : ShapeRepelAffector(range, QSharedPointer<const ShapeField>(new ShapeField(ShapeField::heart(center, scale, repelRange))), repelForce, repelRange) {}
 };
 
 
@@ -0,0 +1,397 @@
+#include "audioanalyzer.h"
+#include <QAudioDecoder>
+#include <QAudioBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+#include <QtMath>
+#include <complex>
+
+#define BEATMAP_MAGIC 0x5044424D      //"PDBM"
+#define BEATMAP_VERSION 1
+
+namespace {
+
+const int FrameSize = 1024;           //STFT窗口长度
+
+//基2迭代FFT(原地)
+void fft(QVector<std::complex<float>> &a)
+{
+    const int n = a.count();
+    for (int i = 1, j = 0; i < n; ++i) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if(i < j)
+        {
+            std::swap(a[i], a[j]);
+        }
+    }
+    for (int length = 2; length <= n; length <<= 1) {
+        const float angle = float(-2 * M_PI / length);
+        const std::complex<float> step(std::cos(angle), std::sin(angle));
+        for (int i = 0; i < n; i += length) {
+            std::complex<float> w(1.0f, 0.0f);
+            for (int j = 0; j < length / 2; ++j) {
+                const std::complex<float> u = a[i + j];
+                const std::complex<float> v = a[i + j + length / 2] * w;
+                a[i + j] = u + v;
+                a[i + j + length / 2] = u - v;
+                w *= step;
+            }
+        }
+    }
+}
+
+//将序列归一化并量化到0~255
+QVector<quint8> quantize(const QVector<float> &values)
+{
+    float maxValue = 0;
+    for (float value : values) {
+        maxValue = std::max(maxValue, value);
+    }
+    QVector<quint8> result(values.count());
+    for (int i = 0; i < values.count(); ++i) {
+        result[i] = maxValue > 0 ? quint8(qBound(0, qRound(values.at(i) / maxValue * 255), 255)) : 0;
+    }
+    return result;
+}
+
+}
+
+//-------------------------------------------------------------------------------------------
+
+int BeatMap::frameAt(qint64 position) const
+{
+    return int(qBound<qint64>(0, position / m_hop, std::max(frameCount() - 1, 0)));
+}
+
+qreal BeatMap::energy(int band, qint64 position) const
+{
+    if(m_onset.isEmpty() || band < 0 || band >= BandCount)
+    {
+        return 0;
+    }
+    return m_energy.at(frameAt(position) * BandCount + band) / 255.0;
+}
+
+qreal BeatMap::onset(qint64 position) const
+{
+    if(m_onset.isEmpty())
+    {
+        return 0;
+    }
+    return m_onset.at(frameAt(position)) / 255.0;
+}
+
+qint64 BeatMap::nextBeat(qint64 position) const
+{
+    auto it = std::lower_bound(m_beats.constBegin(), m_beats.constEnd(), quint32(std::max<qint64>(position, 0)));
+    return it == m_beats.constEnd() ? -1 : qint64(*it);
+}
+
+qreal BeatMap::beatPhase(qint64 position) const
+{
+    auto it = std::upper_bound(m_beats.constBegin(), m_beats.constEnd(), quint32(std::max<qint64>(position, 0)));
+    if(it == m_beats.constBegin() || it == m_beats.constEnd())
+    {
+        return 0;
+    }
+    const qint64 previous = *(it - 1);
+    return qreal(position - previous) / (qint64(*it) - previous);
+}
+
+bool BeatMap::beatBetween(qint64 from, qint64 to) const
+{
+    const qint64 beat = nextBeat(from + 1);
+    return beat >= 0 && beat <= to;
+}
+
+bool BeatMap::save(const QString &fileName, const QByteArray &key) const
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    QDataStream out(&file);
+    out << quint32(BEATMAP_MAGIC) << quint16(BEATMAP_VERSION) << key
+        << qint32(m_hop) << m_bpm << m_energy << m_onset << m_beats;
+    return out.status() == QDataStream::Ok;
+}
+
+QSharedPointer<const BeatMap> BeatMap::load(const QString &fileName, const QByteArray &key)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        return {};
+    }
+    QDataStream in(&file);
+    quint32 magic;
+    quint16 version;
+    QByteArray fileKey;
+    in >> magic >> version >> fileKey;
+    if(magic != BEATMAP_MAGIC || version != BEATMAP_VERSION || fileKey != key)
+    {
+        return {};
+    }
+    auto map = QSharedPointer<BeatMap>::create();
+    qint32 hop;
+    in >> hop >> map->m_bpm >> map->m_energy >> map->m_onset >> map->m_beats;
+    map->m_hop = hop;
+    if(in.status() != QDataStream::Ok || hop <= 0 || map->m_energy.count() != map->m_onset.count() * BandCount)
+    {
+        return {};
+    }
+    return map;
+}
+
+//-------------------------------------------------------------------------------------------
+
+AudioAnalyzer::AudioAnalyzer(QObject *parent)
+    : QObject(parent)
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+//等待进行中的分析结束，分析任务不会在本对象析构后访问它；已排队的通知随本对象一起丢弃
+AudioAnalyzer::~AudioAnalyzer()
+{
+    m_pool.waitForDone();
+}
+
+void AudioAnalyzer::analyze(const QString &fileName)
+{
+    m_file = new QFile(fileName, this);
+    if(!m_file->open(QIODevice::ReadOnly))
+    {
+        qDebug() << "无法打开音频:" << fileName;
+        return;
+    }
+    m_key = QCryptographicHash::hash(m_file->readAll(), QCryptographicHash::Md5);
+    m_file->seek(0);
+
+    //命中缓存
+    if(auto map = BeatMap::load(cacheFileName(), m_key))
+    {
+        qDebug() << "已加载节拍缓存" << cacheFileName();
+        emit finished(map);
+        return;
+    }
+
+    QAudioFormat format;
+    format.setSampleRate(22050);
+    format.setChannelCount(1);
+    format.setSampleFormat(QAudioFormat::Float);
+
+    m_decoder = new QAudioDecoder(this);
+    m_decoder->setAudioFormat(format);
+    m_decoder->setSourceDevice(m_file);
+    connect(m_decoder,&QAudioDecoder::bufferReady,this,&AudioAnalyzer::onBufferReady);
+    connect(m_decoder,&QAudioDecoder::finished,this,&AudioAnalyzer::onDecodingFinished);
+    connect(m_decoder,qOverload<QAudioDecoder::Error>(&QAudioDecoder::error),this,[this]() {
+        qDebug() << "音频解码失败:" << m_decoder->errorString();
+    });
+    m_decoder->start();
+}
+
+//解码器未必遵循请求的格式，按实际格式转换为单声道浮点
+void AudioAnalyzer::onBufferReady()
+{
+    const QAudioBuffer buffer = m_decoder->read();
+    const QAudioFormat format = buffer.format();
+    const int channels = std::max(format.channelCount(), 1);
+    const int frames = int(buffer.frameCount());
+    if(m_sampleRate == 0)
+    {
+        m_sampleRate = format.sampleRate();
+    }
+
+    auto append = [&](auto data, float scale, float offset) {
+        for (int i = 0; i < frames; ++i) {
+            float sum = 0;
+            for (int c = 0; c < channels; ++c) {
+                sum += (float(data[i * channels + c]) - offset) * scale;
+            }
+            m_samples.append(sum / channels);
+        }
+    };
+    switch (format.sampleFormat()) {
+    case QAudioFormat::Float:
+        append(buffer.constData<float>(), 1.0f, 0.0f);
+        break;
+    case QAudioFormat::Int16:
+        append(buffer.constData<qint16>(), 1.0f / 32768.0f, 0.0f);
+        break;
+    case QAudioFormat::Int32:
+        append(buffer.constData<qint32>(), 1.0f / 2147483648.0f, 0.0f);
+        break;
+    case QAudioFormat::UInt8:
+        append(buffer.constData<quint8>(), 1.0f / 128.0f, 128.0f);
+        break;
+    default:
+        break;
+    }
+}
+
+void AudioAnalyzer::onDecodingFinished()
+{
+    if(m_sampleRate <= 0 || m_samples.isEmpty())
+    {
+        return;
+    }
+
+    //分析在本对象持有的线程池中进行，完成后回到本对象所在线程写缓存并通知
+    m_pool.start([this, samples = std::move(m_samples), sampleRate = m_sampleRate]() {
+        QSharedPointer<const BeatMap> map = compute(samples, sampleRate);
+        QMetaObject::invokeMethod(this, [this, map]() {
+            if(!map->save(cacheFileName(), m_key))
+            {
+                qDebug() << "节拍缓存写入失败" << cacheFileName();
+            }
+            emit finished(map);
+        }, Qt::QueuedConnection);
+    });
+    m_samples.clear();
+}
+
+QString AudioAnalyzer::cacheFileName() const
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QDir().mkpath(dir);
+    return dir + "/" + m_key.toHex() + ".beatmap";
+}
+
+QSharedPointer<BeatMap> AudioAnalyzer::compute(const QVector<float> &samples, int sampleRate, int hop)
+{
+    auto map = QSharedPointer<BeatMap>::create();
+    map->m_hop = hop;
+    const int hopSamples = std::max(1, sampleRate * hop / 1000);
+    const int frames = std::max(0, int((samples.count() - FrameSize) / hopSamples) + 1);
+    const int bins = FrameSize / 2;
+
+    //各频段对应的频点范围
+    const float binHz = float(sampleRate) / FrameSize;
+    const float edges[BeatMap::BandCount + 1] = {20.0f, 150.0f, 800.0f, 4000.0f, sampleRate / 2.0f};
+    int bandStart[BeatMap::BandCount + 1];
+    for (int b = 0; b <= BeatMap::BandCount; ++b) {
+        bandStart[b] = qBound(1, int(edges[b] / binHz), bins);
+    }
+
+    QVector<float> window(FrameSize);
+    for (int i = 0; i < FrameSize; ++i) {
+        window[i] = 0.5f - 0.5f * std::cos(float(2 * M_PI * i / (FrameSize - 1)));
+    }
+
+    QVector<float> energy(frames * BeatMap::BandCount);
+    QVector<float> flux(frames);
+    QVector<float> previous(bins, 0.0f);
+    QVector<float> magnitude(bins);
+    QVector<std::complex<float>> spectrum(FrameSize);
+    for (int f = 0; f < frames; ++f) {
+        const float *frame = samples.constData() + f * hopSamples;
+        for (int i = 0; i < FrameSize; ++i) {
+            spectrum[i] = std::complex<float>(frame[i] * window[i], 0.0f);
+        }
+        fft(spectrum);
+
+        //对数幅度谱的正向差分之和即频谱通量
+        float frameFlux = 0;
+        for (int k = 0; k < bins; ++k) {
+            magnitude[k] = std::log1p(std::abs(spectrum[k]));
+            frameFlux += std::max(0.0f, magnitude[k] - previous[k]);
+        }
+        std::swap(previous, magnitude);
+        flux[f] = frameFlux;
+
+        for (int b = 0; b < BeatMap::BandCount; ++b) {
+            float sum = 0;
+            for (int k = bandStart[b]; k < bandStart[b + 1]; ++k) {
+                sum += std::norm(spectrum[k]);
+            }
+            energy[f * BeatMap::BandCount + b] = std::log1p(sum);
+        }
+    }
+
+    //各频段分别归一化
+    map->m_energy.resize(energy.count());
+    for (int b = 0; b < BeatMap::BandCount; ++b) {
+        QVector<float> band(frames);
+        for (int f = 0; f < frames; ++f) {
+            band[f] = energy.at(f * BeatMap::BandCount + b);
+        }
+        const QVector<quint8> quantized = quantize(band);
+        for (int f = 0; f < frames; ++f) {
+            map->m_energy[f * BeatMap::BandCount + b] = quantized.at(f);
+        }
+    }
+
+    //起音包络：减去局部均值(约0.5秒)后取正
+    const int radius = std::max(1, 250 / hop);
+    QVector<float> onset(frames);
+    for (int f = 0; f < frames; ++f) {
+        float sum = 0;
+        int count = 0;
+        for (int i = std::max(0, f - radius); i <= std::min(frames - 1, f + radius); ++i) {
+            sum += flux.at(i);
+            count++;
+        }
+        onset[f] = std::max(0.0f, flux.at(f) - sum / count);
+    }
+    map->m_onset = quantize(onset);
+
+    //速度估计：起音包络在60~180BPM范围内的自相关峰值
+    const int minLag = std::max(1, 60000 / (180 * hop));
+    const int maxLag = std::max(minLag, 60000 / (60 * hop));
+    int period = 0;
+    float best = 0;
+    for (int lag = minLag; lag <= maxLag; ++lag) {
+        float sum = 0;
+        for (int f = lag; f < frames; ++f) {
+            sum += onset.at(f) * onset.at(f - lag);
+        }
+        if(sum > best)
+        {
+            best = sum;
+            period = lag;
+        }
+    }
+    if(period <= 0)
+    {
+        return map;
+    }
+    map->m_bpm = 60000.0 / (period * hop);
+
+    //相位估计：使节拍网格上起音强度之和最大的偏移，再在每拍附近对齐到局部起音峰值
+    int phase = 0;
+    best = -1;
+    for (int offset = 0; offset < period; ++offset) {
+        float sum = 0;
+        for (int f = offset; f < frames; f += period) {
+            sum += onset.at(f);
+        }
+        if(sum > best)
+        {
+            best = sum;
+            phase = offset;
+        }
+    }
+    const int tolerance = std::max(1, period / 8);
+    for (int f = phase; f < frames; f += period) {
+        int peak = f;
+        for (int i = std::max(0, f - tolerance); i <= std::min(frames - 1, f + tolerance); ++i) {
+            if(onset.at(i) > onset.at(peak))
+            {
+                peak = i;
+            }
+        }
+        map->m_beats.append(quint32(peak * hop));
+    }
+    return map;
+}
@@ -0,0 +1,94 @@
+#ifndef AUDIOANALYZER_H
+#define AUDIOANALYZER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QVector>
+
+class QAudioDecoder;
+class QFile;
+
+//节拍与能量图
+//离线分析的结果：按固定间隔(hop)保存各频段能量包络与起音强度(均量化为0~255)，以及节拍时间点，
+//运行时只做查表，没有任何实时DSP开销
+class BeatMap
+{
+public:
+    enum Band {
+        Bass,           //20~150Hz
+        LowMid,         //150~800Hz
+        HighMid,        //800~4000Hz
+        Treble,         //4000Hz以上
+        BandCount
+    };
+
+    int hop() const {return m_hop;}
+    int frameCount() const {return m_onset.count();}
+    qreal bpm() const {return m_bpm;}
+    const QVector<quint32> &beats() const {return m_beats;}
+
+    qreal energy(int band, qint64 position) const;      //频段能量[0,1]
+    qreal onset(qint64 position) const;                 //起音强度[0,1]
+    qint64 nextBeat(qint64 position) const;             //position之后(含)的第一个节拍，没有时返回-1
+    qreal beatPhase(qint64 position) const;             //在当前拍内的进度[0,1)
+    bool beatBetween(qint64 from, qint64 to) const;     //(from, to]内是否有节拍
+
+    bool save(const QString &fileName, const QByteArray &key) const;
+    static QSharedPointer<const BeatMap> load(const QString &fileName, const QByteArray &key);
+
+private:
+    friend class AudioAnalyzer;
+    int frameAt(qint64 position) const;
+
+    int m_hop = 20;                     //帧间隔(毫秒)
+    qreal m_bpm = 0;
+    QVector<quint8> m_energy;           //按帧交错存储，每帧BandCount个频段
+    QVector<quint8> m_onset;
+    QVector<quint32> m_beats;           //节拍时间点(毫秒)
+};
+
+//节拍图槽：分析完成前为空，完成后在GUI线程写入；时间线线程创建的发射器共享同一个槽，每次发射时取当前的图
+class BeatMapSlot
+{
+public:
+    void set(const QSharedPointer<const BeatMap> &beatMap){QMutexLocker locker(&m_mutex); m_beatMap = beatMap;}
+    QSharedPointer<const BeatMap> get() const {QMutexLocker locker(&m_mutex); return m_beatMap;}
+
+private:
+    mutable QMutex m_mutex;
+    QSharedPointer<const BeatMap> m_beatMap;
+};
+
+//音频分析器：QAudioDecoder解码为单声道浮点，STFT计算频段能量、频谱通量起音与节拍，结果按音频内容哈希缓存到磁盘
+class AudioAnalyzer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AudioAnalyzer(QObject *parent = nullptr);
+    ~AudioAnalyzer();
+
+    void analyze(const QString &fileName);             //有缓存时直接加载，否则后台解码分析
+
+    static QSharedPointer<BeatMap> compute(const QVector<float> &samples, int sampleRate, int hop = 20);
+
+signals:
+    void finished(QSharedPointer<const BeatMap> beatMap);
+
+private slots:
+    void onBufferReady();
+    void onDecodingFinished();
+
+private:
+    QString cacheFileName() const;
+
+    QAudioDecoder *m_decoder = nullptr;
+    QFile *m_file = nullptr;
+    QByteArray m_key;                   //音频内容哈希
+    QVector<float> m_samples;
+    int m_sampleRate = 0;
+    QThreadPool m_pool;                 //分析线程(析构时等待)
+};
+
+#endif // AUDIOANALYZER_H
@@ -0,0 +1,164 @@
+#include "barneshut.h"
+#include <QtMath>
+#include <algorithm>
+
+BarnesHut::BarnesHut(qreal theta, qreal softening, int leafSize)
+    : m_leafSize(std::max(leafSize, 1))
+{
+    setTheta(theta);
+    setSoftening(softening);
+}
+
+void BarnesHut::setTheta(qreal theta)
+{
+    //theta超过√2时粒子所在的节点也可能被近似，连带自身参与计算
+    theta = qBound<qreal>(0.0, theta, 1.2);
+    m_theta2 = float(theta * theta);
+}
+
+void BarnesHut::build(const QVector<Source> &sources)
+{
+    m_sources = sources;
+    m_nodes.clear();
+    if(m_sources.isEmpty())
+    {
+        return;
+    }
+
+    //包围所有源的正方形作为根节点
+    qreal minX = m_sources.first().position.x(), maxX = minX;
+    qreal minY = m_sources.first().position.y(), maxY = minY;
+    for (const Source &source : std::as_const(m_sources)) {
+        minX = std::min(minX, source.position.x());
+        maxX = std::max(maxX, source.position.x());
+        minY = std::min(minY, source.position.y());
+        maxY = std::max(maxY, source.position.y());
+    }
+    const float half = float(std::max(maxX - minX, maxY - minY) / 2) + 1.0f;
+    m_nodes.reserve(m_sources.count() * 2 / m_leafSize + 1);
+    m_nodes.append(Node());
+    buildNode(0, float(minX + maxX) / 2, float(minY + maxY) / 2, half, 0, int(m_sources.count()), 0);
+}
+
+void BarnesHut::buildNode(int index, float x, float y, float half, int first, int count, int depth)
+{
+    Node node;
+    node.x = x;
+    node.y = y;
+    node.half = half;
+    node.child = -1;
+    node.first = first;
+    node.count = count;
+
+    //汇总质量与旋量(中心按绝对值加权，正负源混合时中心仍落在源之间)
+    float mass = 0, massX = 0, massY = 0, massWeight = 0;
+    float spin = 0, spinX = 0, spinY = 0, spinWeight = 0;
+    for (int i = first; i < first + count; ++i) {
+        const Source &source = m_sources.at(i);
+        const float px = float(source.position.x());
+        const float py = float(source.position.y());
+        const float m = std::abs(source.mass);
+        const float s = std::abs(source.spin);
+        mass += source.mass;
+        massX += m * px;
+        massY += m * py;
+        massWeight += m;
+        spin += source.spin;
+        spinX += s * px;
+        spinY += s * py;
+        spinWeight += s;
+    }
+    node.mass = mass;
+    node.massX = massWeight > 0 ? massX / massWeight : x;
+    node.massY = massWeight > 0 ? massY / massWeight : y;
+    node.spin = spin;
+    node.spinX = spinWeight > 0 ? spinX / spinWeight : x;
+    node.spinY = spinWeight > 0 ? spinY / spinWeight : y;
+
+    if(count <= m_leafSize || depth >= BARNESHUT_MAX_DEPTH)
+    {
+        m_nodes[index] = node;
+        return;
+    }
+
+    //按象限原地重排：先分上下，再各自分左右，子节点覆盖连续的区间
+    Source *begin = m_sources.data() + first;
+    Source *end = begin + count;
+    Source *middle = std::partition(begin, end, [y](const Source &source) {return source.position.y() < y;});
+    Source *top = std::partition(begin, middle, [x](const Source &source) {return source.position.x() < x;});
+    Source *bottom = std::partition(middle, end, [x](const Source &source) {return source.position.x() < x;});
+
+    node.child = int(m_nodes.count());
+    m_nodes[index] = node;
+    m_nodes.resize(m_nodes.count() + 4);
+    const float quarter = half / 2;
+    buildNode(node.child,     x - quarter, y - quarter, quarter, first,                        int(top - begin),     depth + 1);
+    buildNode(node.child + 1, x + quarter, y - quarter, quarter, first + int(top - begin),     int(middle - top),    depth + 1);
+    buildNode(node.child + 2, x - quarter, y + quarter, quarter, first + int(middle - begin),  int(bottom - middle), depth + 1);
+    buildNode(node.child + 3, x + quarter, y + quarter, quarter, first + int(bottom - begin),  int(end - bottom),    depth + 1);
+}
+
+//单个(或汇总后的)源：吸引按软化的平方反比，涡旋按软化的距离反比
+void BarnesHut::contribute(float px, float py, float cx, float cy, float mass, float spin, float *ax, float *ay) const
+{
+    const float rx = cx - px;
+    const float ry = cy - py;
+    const float inverse2 = 1.0f / (rx * rx + ry * ry + m_softening2);
+    const float inverse3 = inverse2 * std::sqrt(inverse2);
+    *ax += mass * rx * inverse3 + spin * ry * inverse2;
+    *ay += mass * ry * inverse3 - spin * rx * inverse2;
+}
+
+QVector2D BarnesHut::field(const QPointF &position, const void *exclude) const
+{
+    if(m_nodes.isEmpty())
+    {
+        return QVector2D();
+    }
+    const float px = float(position.x());
+    const float py = float(position.y());
+    float ax = 0;
+    float ay = 0;
+
+    //显式栈遍历：每层最多压入4个子节点
+    int stack[4 * BARNESHUT_MAX_DEPTH + 4];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const Node &node = m_nodes.at(stack[--size]);
+        if(node.count == 0)
+        {
+            continue;
+        }
+        const float dx = node.x - px;
+        const float dy = node.y - py;
+        const float side = 2 * node.half;
+        if(node.child >= 0)
+        {
+            if(side * side < m_theta2 * (dx * dx + dy * dy))
+            {
+                //足够远：整个节点作为一个源
+                contribute(px, py, node.massX, node.massY, node.mass, 0, &ax, &ay);
+                contribute(px, py, node.spinX, node.spinY, 0, node.spin, &ax, &ay);
+            }
+            else
+            {
+                for (int i = 0; i < 4; ++i) {
+                    stack[size++] = node.child + i;
+                }
+            }
+            continue;
+        }
+
+        //叶节点逐个精确求和
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            const Source &source = m_sources.at(i);
+            if(exclude && source.key == exclude)
+            {
+                continue;
+            }
+            contribute(px, py, float(source.position.x()), float(source.position.y()), source.mass, source.spin, &ax, &ay);
+        }
+    }
+    return QVector2D(ax, ay);
+}
@@ -0,0 +1,54 @@
+#ifndef BARNESHUT_H
+#define BARNESHUT_H
+
+#include <QPointF>
+#include <QVector2D>
+#include <QVector>
+
+#define BARNESHUT_MAX_DEPTH 16      //重合点过多时停止细分的深度
+
+//Barnes–Hut四叉树
+//每帧用源(引力点、涡旋点)重建：每个节点汇总子树的总质量/总旋量及各自的中心，
+//查询时节点边长与距离之比小于theta就把整个节点当作一个源，m个源对n个粒子的代价从O(n·m)降为O(n·log m)
+class BarnesHut
+{
+public:
+    struct Source
+    {
+        QPointF position;
+        float mass;             //>0吸引、<0排斥(汇总只保留单极，同号源误差小，正负混杂时宜分成两棵树)
+        float spin;             //涡旋强度，>0时在屏幕上顺时针旋转
+        const void *key;        //所属对象(查询时用于排除自身)
+    };
+
+    explicit BarnesHut(qreal theta = 0.5, qreal softening = 20.0, int leafSize = 4);
+
+    void setTheta(qreal theta);                 //精度：0为精确求和，越大越快越粗略(上限1.2)
+    void setSoftening(qreal softening){m_softening2 = float(softening * softening);}
+    void build(const QVector<Source> &sources);
+    int count() const {return m_sources.count();}
+
+    //position处的合加速度(吸引/排斥沿连线方向，涡旋垂直于连线)，exclude对应的源不参与计算
+    QVector2D field(const QPointF &position, const void *exclude = nullptr) const;
+
+private:
+    struct Node
+    {
+        float x, y, half;       //正方形中心与半边长
+        float mass, massX, massY;       //总质量与质心(按|质量|加权)
+        float spin, spinX, spinY;       //总旋量与旋量中心(按|旋量|加权)
+        int child;              //第一个子节点下标(4个连续)，叶节点为-1
+        int first, count;       //覆盖的源在m_sources中的范围
+    };
+
+    void buildNode(int index, float x, float y, float half, int first, int count, int depth);
+    void contribute(float px, float py, float cx, float cy, float mass, float spin, float *ax, float *ay) const;
+
+    float m_theta2;
+    float m_softening2;
+    int m_leafSize;
+    QVector<Node> m_nodes;
+    QVector<Source> m_sources;  //按节点重排后的源
+};
+
+#endif // BARNESHUT_H
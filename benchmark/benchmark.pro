@@ -0,0 +1,61 @@
+QT       += core gui widgets multimedia
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = pipedream-benchmark
+
+# 与主程序共用场景代码，不含窗口与音乐播放(pipedream.cpp、main.cpp)
+INCLUDEPATH += ..
+
+# 粒子运行状态默认单精度，qmake CONFIG+=particle_double 切换为双精度
+particle_double: DEFINES += PARTICLE_DOUBLE_PRECISION
+
+SOURCES += \
+    main.cpp \
+    ../affector.cpp \
+    ../audioanalyzer.cpp \
+    ../barneshut.cpp \
+    ../emissionshape.cpp \
+    ../emitter.cpp \
+    ../flowfield.cpp \
+    ../framedriver.cpp \
+    ../graphicsitems.cpp \
+    ../lifetimelut.cpp \
+    ../scheduler.cpp \
+    ../screenwriter.cpp \
+    ../sequencer.cpp \
+    ../shapefield.cpp \
+    ../showstats.cpp \
+    ../simrandom.cpp \
+    ../spatialhash.cpp \
+    ../splat.cpp \
+    ../synclatency.cpp \
+    ../transition.cpp
+
+HEADERS += \
+    ../affector.h \
+    ../audioanalyzer.h \
+    ../barneshut.h \
+    ../emissionshape.h \
+    ../emitter.h \
+    ../flowfield.h \
+    ../framedriver.h \
+    ../graphicsitems.h \
+    ../lifetimelut.h \
+    ../scheduler.h \
+    ../screenwriter.h \
+    ../sequencer.h \
+    ../shapefield.h \
+    ../showstats.h \
+    ../simrandom.h \
+    ../spatialhash.h \
+    ../splat.h \
+    ../synclatency.h \
+    ../transition.h \
+    ../triplebuffer.h
+
+RESOURCES += \
+    ../resource.qrc
+
+win32: LIBS += -lpsapi
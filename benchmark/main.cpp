@@ -0,0 +1,211 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGraphicsScene>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QTextStream>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+#include "sequencer.h"
+#include "showstats.h"
+#include "simrandom.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+//场景基准测试：以固定随机种子、固定模拟时长逐个运行各场景(离屏平台，无音频、无窗口)，
+//每帧计时模拟与离屏渲染，输出帧时间均值与分位数、粒子峰值和内存峰值(JSON)
+
+namespace {
+
+struct SceneEntry
+{
+    const char *name;
+    int id;
+};
+
+const SceneEntry scenes[] = {
+    {"sakura", Sequencer::SakuraScene},
+    {"firefly", Sequencer::FireflyScene},
+    {"spiral", Sequencer::SpiralScene},
+    {"fireworks", Sequencer::FireworksScene},
+    {"orchid", Sequencer::OrchidScene},
+};
+
+//重置进程内存峰值(Linux写clear_refs，失败时报告的是进程启动以来的峰值)
+void resetPeakRss()
+{
+#ifdef Q_OS_LINUX
+    QFile file("/proc/self/clear_refs");
+    if(file.open(QIODevice::WriteOnly))
+    {
+        file.write("5");
+    }
+#endif
+}
+
+//进程内存峰值(KiB)，无法获取时返回-1
+qint64 peakRss()
+{
+#if defined(Q_OS_LINUX)
+    QFile file("/proc/self/status");
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        return -1;
+    }
+    QTextStream in(&file);
+    QString line;
+    while (in.readLineInto(&line)) {
+        if(line.startsWith("VmHWM:"))
+        {
+            return line.mid(6).trimmed().section(' ', 0, 0).toLongLong();
+        }
+    }
+    return -1;
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return qint64(counters.PeakWorkingSetSize / 1024);
+    }
+    return -1;
+#else
+    return -1;
+#endif
+}
+
+double percentile(const QVector<double> &sorted, double p)
+{
+    if(sorted.isEmpty())
+    {
+        return 0;
+    }
+    const int index = qBound(0, int(std::ceil(p * sorted.count())) - 1, int(sorted.count()) - 1);
+    return sorted.at(index);
+}
+
+QJsonObject runScene(const SceneEntry &entry, quint64 seed, int duration, const QSize &resolution, bool pipelined)
+{
+    SimRandom::global()->seed(seed);
+    QGraphicsScene scene(0, 0, 1440, 900);
+    QImage frame(resolution, QImage::Format_ARGB32_Premultiplied);
+    QVector<double> frameTimes;
+    int peakParticles = 0;
+
+    resetPeakRss();
+    {
+        Sequencer sequencer(&scene, nullptr, false);
+        sequencer.setPipelined(pipelined);
+        sequencer.buildScene(entry.id);
+
+        QElapsedTimer timer;
+        for (int time = 0; time < duration; time += TICK_INTERVAL) {
+            timer.start();
+            sequencer.step();
+            QPainter painter(&frame);
+            painter.setRenderHint(QPainter::Antialiasing);
+            frame.fill(Qt::black);
+            scene.render(&painter, QRectF(QPointF(0,0), resolution), scene.sceneRect());
+            painter.end();
+            frameTimes.append(timer.nsecsElapsed() / 1e6);
+
+            peakParticles = std::max(peakParticles, int(ShowStats::global()->liveCount()));     //各编剧自己统计的存活元素(花瓣层、兰花也计入)
+        }
+    }
+
+    double total = 0;
+    for (double time : std::as_const(frameTimes)) {
+        total += time;
+    }
+    QVector<double> sorted = frameTimes;
+    std::sort(sorted.begin(), sorted.end());
+
+    QJsonObject result;
+    result["name"] = entry.name;
+    result["frames"] = int(frameTimes.count());
+    result["meanMs"] = frameTimes.isEmpty() ? 0 : total / frameTimes.count();
+    result["p50Ms"] = percentile(sorted, 0.50);
+    result["p95Ms"] = percentile(sorted, 0.95);
+    result["p99Ms"] = percentile(sorted, 0.99);
+    result["maxMs"] = sorted.isEmpty() ? 0 : sorted.last();
+    result["peakParticles"] = peakParticles;
+    result["peakRssKiB"] = peakRss();
+    return result;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    //无窗口运行
+    if(qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("PipeDream 场景基准测试");
+    parser.addHelpOption();
+    QCommandLineOption sceneOption("scene", "只运行指定场景(sakura/firefly/spiral/fireworks/orchid)，可重复", "name");
+    QCommandLineOption durationOption("duration", "每个场景的模拟时长(毫秒)", "ms", "30000");
+    QCommandLineOption seedOption("seed", "随机种子", "seed", "1");
+    QCommandLineOption resolutionOption("resolution", "离屏渲染分辨率", "WxH", "1440x900");
+    QCommandLineOption outputOption("output", "结果输出文件(默认标准输出)", "file");
+    QCommandLineOption pipelinedOption("pipelined", "流水线模式：粒子光栅化与下一步模拟重叠");
+    parser.addOptions({sceneOption, durationOption, seedOption, resolutionOption, outputOption, pipelinedOption});
+    parser.process(a);
+
+    const QStringList selected = parser.values(sceneOption);
+    const int duration = parser.value(durationOption).toInt();
+    const quint64 seed = parser.value(seedOption).toULongLong();
+    const QStringList size = parser.value(resolutionOption).split('x');
+    const QSize resolution = size.count() == 2 ? QSize(size.at(0).toInt(), size.at(1).toInt()) : QSize(1440, 900);
+    if(duration <= 0 || resolution.isEmpty())
+    {
+        qWarning() << "参数错误";
+        return 1;
+    }
+
+    QJsonArray results;
+    for (const SceneEntry &entry : scenes) {
+        if(!selected.isEmpty() && !selected.contains(entry.name))
+        {
+            continue;
+        }
+        results.append(runScene(entry, seed, duration, resolution, parser.isSet(pipelinedOption)));
+    }
+
+    QJsonObject report;
+    report["seed"] = QString::number(seed);
+    report["durationMs"] = duration;
+    report["resolution"] = QString("%1x%2").arg(resolution.width()).arg(resolution.height());
+    report["pipelined"] = parser.isSet(pipelinedOption);
+    report["scenes"] = results;
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    if(parser.isSet(outputOption))
+    {
+        QFile file(parser.value(outputOption));
+        if(!file.open(QIODevice::WriteOnly))
+        {
+            qWarning() << "无法写入" << file.fileName();
+            return 1;
+        }
+        file.write(json);
+    }
+    else
+    {
+        QTextStream(stdout) << json;
+    }
+    return 0;
+}
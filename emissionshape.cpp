@@ -0,0 +1,161 @@
+#include "emissionshape.h"
+#include "simrandom.h"
+#include <QPainter>
+#include <QtMath>
+
+EmissionShape EmissionShape::fromImage(const QImage &image, const QRectF &target)
+{
+    EmissionShape shape;
+    if(image.isNull() || target.isEmpty())
+    {
+        return shape;
+    }
+
+    QImage source = image;
+    if(source.width() > EMISSION_SHAPE_MAX_SIDE || source.height() > EMISSION_SHAPE_MAX_SIDE)
+    {
+        source = source.scaled(EMISSION_SHAPE_MAX_SIDE, EMISSION_SHAPE_MAX_SIDE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    //有透明通道时取alpha，否则取灰度作为权重
+    QImage weights(source.size(), QImage::Format_Grayscale8);
+    if(source.hasAlphaChannel())
+    {
+        const QImage argb = source.convertToFormat(QImage::Format_ARGB32);
+        for (int y = 0; y < argb.height(); ++y) {
+            const QRgb *line = reinterpret_cast<const QRgb*>(argb.constScanLine(y));
+            uchar *out = weights.scanLine(y);
+            for (int x = 0; x < argb.width(); ++x) {
+                out[x] = uchar(qAlpha(line[x]));
+            }
+        }
+    }
+    else
+    {
+        weights = source.convertToFormat(QImage::Format_Grayscale8);
+    }
+
+    shape.m_bounds = target;
+    shape.m_cellWidth = target.width() / weights.width();
+    shape.m_cellHeight = target.height() / weights.height();
+    shape.build(weights);
+    return shape;
+}
+
+EmissionShape EmissionShape::fromPath(const QPainterPath &path, bool fill, qreal penWidth, qreal cellSize)
+{
+    EmissionShape shape;
+    const qreal margin = fill ? 0.0 : penWidth / 2;
+    const QRectF bounds = path.boundingRect().adjusted(-margin,-margin,margin,margin);
+    if(bounds.isEmpty())
+    {
+        return shape;
+    }
+    cellSize = std::max(cellSize, std::max(bounds.width(), bounds.height()) / EMISSION_SHAPE_MAX_SIDE);
+    const int cols = std::max(1, qCeil(bounds.width() / cellSize));
+    const int rows = std::max(1, qCeil(bounds.height() / cellSize));
+
+    //抗锯齿栅格化，边缘格子得到部分权重
+    QImage weights(cols, rows, QImage::Format_Grayscale8);
+    weights.fill(0);
+    QPainter painter(&weights);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.scale(1.0 / cellSize, 1.0 / cellSize);
+    painter.translate(-bounds.topLeft());
+    if(fill)
+    {
+        painter.fillPath(path, Qt::white);
+    }
+    else
+    {
+        painter.strokePath(path, QPen(Qt::white, penWidth));
+    }
+    painter.end();
+
+    shape.m_bounds = QRectF(bounds.topLeft(), QSizeF(cols * cellSize, rows * cellSize));
+    shape.m_cellWidth = cellSize;
+    shape.m_cellHeight = cellSize;
+    shape.build(weights);
+    return shape;
+}
+
+EmissionShape EmissionShape::fromText(const QString &text, const QFont &font, const QRectF &target, bool fill, qreal cellSize)
+{
+    QPainterPath path;
+    path.addText(0, 0, font, text);
+    path.translate(target.center() - path.boundingRect().center());
+    return fromPath(path, fill, 2.0, cellSize);
+}
+
+//Vose算法构建别名表：概率乘以格子数后，不足1的格子用超过1的格子补齐
+void EmissionShape::build(const QImage &weights)
+{
+    m_cells.clear();
+    QVector<float> scaled;
+    double total = 0;
+    for (int y = 0; y < weights.height(); ++y) {
+        const uchar *line = weights.constScanLine(y);
+        for (int x = 0; x < weights.width(); ++x) {
+            if(line[x] == 0)
+            {
+                continue;
+            }
+            m_cells.append({quint16(x), quint16(y), 0, 0.0f});
+            scaled.append(line[x]);
+            total += line[x];
+        }
+    }
+    if(m_cells.isEmpty())
+    {
+        return;
+    }
+
+    const int n = m_cells.count();
+    QVector<int> small;
+    QVector<int> large;
+    for (int i = 0; i < n; ++i) {
+        scaled[i] = float(scaled.at(i) * n / total);
+        if(scaled.at(i) < 1.0f)
+        {
+            small.append(i);
+        }
+        else
+        {
+            large.append(i);
+        }
+    }
+    while(!small.isEmpty() && !large.isEmpty())
+    {
+        const int s = small.takeLast();
+        const int l = large.last();
+        m_cells[s].probability = scaled.at(s);
+        m_cells[s].alias = quint32(l);
+        scaled[l] = (scaled.at(l) + scaled.at(s)) - 1.0f;
+        if(scaled.at(l) < 1.0f)
+        {
+            large.removeLast();
+            small.append(l);
+        }
+    }
+    //剩余的格子(含浮点误差残留)概率为1
+    for (int i : std::as_const(large)) {
+        m_cells[i].probability = 1.0f;
+        m_cells[i].alias = quint32(i);
+    }
+    for (int i : std::as_const(small)) {
+        m_cells[i].probability = 1.0f;
+        m_cells[i].alias = quint32(i);
+    }
+}
+
+QPointF EmissionShape::sample(SimRandom *random) const
+{
+    if(isNull())
+    {
+        return m_bounds.center();
+    }
+    const Cell &column = m_cells.at(random->bounded(int(m_cells.count())));
+    const Cell &cell = random->generateDouble() < column.probability ? column : m_cells.at(column.alias);
+    return QPointF(m_bounds.left() + (cell.x + random->generateDouble()) * m_cellWidth,
+                   m_bounds.top() + (cell.y + random->generateDouble()) * m_cellHeight);
+}
@@ -0,0 +1,52 @@
+#ifndef EMISSIONSHAPE_H
+#define EMISSIONSHAPE_H
+
+#include <QFont>
+#include <QImage>
+#include <QPainterPath>
+#include <QRectF>
+#include <QVector>
+
+#define EMISSION_SHAPE_MAX_SIDE 1024     //栅格边长上限，超过时先缩小图片/加大格子
+
+class SimRandom;
+
+//发射形状
+//将图片、路径或文字栅格化为按像素强度加权的格子集合，并预先构建Walker别名表，
+//运行时每次采样只需一次均匀取下标和一次比较，代价与形状大小无关
+class EmissionShape
+{
+public:
+    EmissionShape() = default;
+
+    //图片带透明通道时按alpha加权，否则按灰度加权；图片缩放到target范围内
+    static EmissionShape fromImage(const QImage &image, const QRectF &target);
+    //fill为false时沿轮廓描边采样(描边宽度penWidth)，cellSize为栅格化格子边长(场景像素)
+    static EmissionShape fromPath(const QPainterPath &path, bool fill = true, qreal penWidth = 2.0, qreal cellSize = 1.0);
+    //文字居中放在target内(按font排版，不缩放)
+    static EmissionShape fromText(const QString &text, const QFont &font, const QRectF &target, bool fill = true, qreal cellSize = 1.0);
+
+    bool isNull() const {return m_cells.isEmpty();}
+    QRectF bounds() const {return m_bounds;}
+    int count() const {return m_cells.count();}
+
+    QPointF sample(SimRandom *random) const;        //按权重随机取点(格子内均匀抖动)
+
+private:
+    void build(const QImage &weights);              //weights为Grayscale8，每个像素对应一个格子
+
+    QRectF m_bounds;
+    qreal m_cellWidth = 1.0;
+    qreal m_cellHeight = 1.0;
+
+    struct Cell
+    {
+        quint16 x;
+        quint16 y;
+        quint32 alias;          //未命中时改取的格子
+        float probability;      //命中本格子的概率
+    };
+    QVector<Cell> m_cells;
+};
+
+#endif // EMISSIONSHAPE_H
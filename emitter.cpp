@@ -1,5 +1,9 @@
 #include "emitter.h"
-#include <QRandomGenerator>
+#include "screenwriter.h"
+#include "showstats.h"
+#include "simrandom.h"
+#include <QDataStream>
+#include <QtMath>
 
 Emitter::Emitter(QGraphicsScene *scene, ParticleFactory factory, QObject *parent)
     : QObject(parent), m_scene(scene), m_factory(factory)
@@ -35,6 +39,12 @@ void Emitter::setPointRange(qreal minX, qreal maxX, qreal minY, qreal maxY)
     max_x = maxX;
     min_y = minY;
     max_y = maxY;
+    m_shape = EmissionShape();
+}
+
+void Emitter::setEmissionShape(const EmissionShape &shape)
+{
+    m_shape = shape;
 }
 
 void Emitter::setVelocity(QVector2D direction, qreal minVelocity, qreal maxVelocity)
@@ -44,10 +54,62 @@ void Emitter::setVelocity(QVector2D direction, qreal minVelocity, qreal maxVeloc
     max_v = maxVelocity;
 }
 
+void Emitter::setOwner(Screenwriter *owner)
+{
+    m_owner = owner;
+    for (const SubEmitter &sub : std::as_const(m_subEmitters)) {
+        sub.emitter->setOwner(owner);
+    }
+}
+
+void Emitter::addSubEmitter(Emitter *emitter, Trigger trigger, int ticks)
+{
+    emitter->setParent(this);
+    emitter->setOwner(m_owner);
+    m_subEmitters.append({emitter, trigger, trigger == OnDeath ? 0 : std::max(1, ticks)});
+}
+
+void Emitter::raiseEvents(const Particle *particle, SpawnQueue *queue)
+{
+    for (const SubEmitter &sub : std::as_const(m_subEmitters)) {
+        bool triggered = false;
+        switch (sub.trigger) {
+        case OnDeath:
+            triggered = particle->isDead();
+            break;
+        case OnTick:
+            triggered = particle->age() > 0 && particle->age() % sub.ticks == 0;
+            break;
+        case OnAge:
+            triggered = particle->age() == sub.ticks;
+            break;
+        }
+        if(triggered)
+        {
+            sub.emitter->emitAt(particle->pos(), queue, sub.trigger == OnDeath ? ShowStats::Exploded : ShowStats::Splashed);
+        }
+    }
+}
+
+void Emitter::emitAt(const QPointF &origin, SpawnQueue *queue, ShowStats::Spawn spawn)
+{
+    if(m_lutDirty)
+    {
+        bakeLifetimeLut();
+    }
+    ShowStats::spawned(m_owner, spawn, m_quantity);
+    for (int i = 0; i < m_quantity; ++i) {
+        auto params = generateParams();
+        params.position += origin;
+        queue->push(createParticle(params));
+    }
+}
+
 void Emitter::setColor(const QColor &startColor, const QColor &endColor)
 {
     m_startColor = startColor;
     m_endColor = endColor;
+    m_lutDirty = true;
 }
 
 void Emitter::setSizeRange(qreal minSize, qreal maxSize)
@@ -62,18 +124,101 @@ void Emitter::setLifeTimeRange(int minLife, int maxLife)
     max_lifeTime = maxLife;
 }
 
+void Emitter::setColorCurve(const QGradientStops &stops)
+{
+    m_colorCurve = stops;
+    m_lutDirty = true;
+}
+
+void Emitter::setAlphaCurve(const LifetimeLut::Curve &curve)
+{
+    m_alphaCurve = curve;
+    m_lutDirty = true;
+}
+
+void Emitter::setSizeCurve(const LifetimeLut::Curve &curve)
+{
+    m_sizeCurve = curve;
+    m_lutDirty = true;
+}
+
+//固定颜色的发射器即使没有设置颜色曲线也烘焙起止颜色的线性渐变，随机颜色且无曲线时不使用查找表
+void Emitter::bakeLifetimeLut()
+{
+    m_lutDirty = false;
+    QGradientStops stops = m_colorCurve;
+    if(stops.isEmpty() && m_startColor.isValid())
+    {
+        stops << QGradientStop(0.0, m_startColor) << QGradientStop(1.0, m_endColor);
+    }
+    if(stops.isEmpty() && m_alphaCurve.isEmpty() && m_sizeCurve.isEmpty())
+    {
+        m_lut.reset();
+        return;
+    }
+    m_lut = QSharedPointer<const LifetimeLut>(new LifetimeLut(stops, m_alphaCurve, m_sizeCurve));
+}
+
+void Emitter::prewarm()
+{
+    bakeLifetimeLut();
+    for (const SubEmitter &sub : std::as_const(m_subEmitters)) {
+        sub.emitter->prewarm();
+    }
+}
+
+void Emitter::setBeatSync(const QSharedPointer<const BeatMapSlot> &beatMap, int band, qreal energyGain, bool onBeat)
+{
+    m_beatMap = beatMap;
+    m_band = band;
+    m_energyGain = energyGain;
+    m_onBeat = onBeat;
+}
+
+void Emitter::setMediaPosition(qint64 position)
+{
+    m_lastPosition = m_position;
+    m_position = position;
+}
+
+void Emitter::saveState(QDataStream &out) const
+{
+    out << qint32(m_delay) << qint32(m_count);
+}
+
+void Emitter::restoreState(QDataStream &in)
+{
+    qint32 delay, count;
+    in >> delay >> count;
+    m_delay = delay;
+    m_count = count;
+}
+
 ParticleParams Emitter::generateParams()
 {
     ParticleParams params;
 
     //设置初始位置
-    qreal point_x = min_x + QRandomGenerator::global()->bounded(max_x - min_x);
-    qreal point_y = min_y + QRandomGenerator::global()->bounded(max_y - min_y);
-    params.position = QPointF(point_x,point_y);
+    if(!m_shape.isNull())
+    {
+        params.position = m_shape.sample(SimRandom::global());
+    }
+    else {
+        qreal point_x = min_x + SimRandom::global()->bounded(max_x - min_x);
+        qreal point_y = min_y + SimRandom::global()->bounded(max_y - min_y);
+        params.position = QPointF(point_x,point_y);
+    }
 
     //设置初始速度
-    params.speed = min_v + QRandomGenerator::global()->bounded(max_v - min_v);
+    params.speed = min_v + SimRandom::global()->bounded(max_v - min_v);
     params.direction = v_direction;
+    if(m_spread > 0)
+    {
+        const qreal angle = qDegreesToRadians(SimRandom::global()->bounded(m_spread) - m_spread / 2);
+        const qreal c = qCos(angle);
+        const qreal s = qSin(angle);
+        params.direction = QVector2D(v_direction.x() * c - v_direction.y() * s, v_direction.x() * s + v_direction.y() * c);
+    }
     params.velocity = params.speed * params.direction;
 
     //设置颜色
@@ -83,26 +228,26 @@ ParticleParams Emitter::generateParams()
         params.endColor = m_endColor;
     }
     else {
-        // int r = QRandomGenerator::global()->bounded(256);
-        // int g = QRandomGenerator::global()->bounded(256);
-        // int b = QRandomGenerator::global()->bounded(256);
-        // int a = QRandomGenerator::global()->bounded(256);
+        // int r = SimRandom::global()->bounded(256);
+        // int g = SimRandom::global()->bounded(256);
+        // int b = SimRandom::global()->bounded(256);
+        // int a = SimRandom::global()->bounded(256);
         // QColor startColor(r,g,b,a);
         // QColor endColor(r,g,b,0);
         // params.startColor = startColor;
         // params.endColor = endColor;
-        int h = QRandomGenerator::global()->bounded(360);
-        int s = QRandomGenerator::global()->bounded(100);
-        int l = QRandomGenerator::global()->bounded(100);
+        int h = SimRandom::global()->bounded(360);
+        int s = SimRandom::global()->bounded(100);
+        int l = SimRandom::global()->bounded(100);
         params.startColor = QColor::fromHsl(h,100,100);
         params.endColor = QColor::fromHsl(h,s,l,0);
     }
 
     //设置粒子大小
-    params.size = min_size + QRandomGenerator::global()->bounded(max_size - min_size);
+    params.size = min_size + SimRandom::global()->bounded(max_size - min_size);
 
     //设置粒子寿命
-    params.lifeTime = min_lifeTime + QRandomGenerator::global()->bounded(max_lifeTime - min_lifeTime);
+    params.lifeTime = min_lifeTime + SimRandom::global()->bounded(max_lifeTime - min_lifeTime);
 
     return params;
 }
@@ -119,19 +264,45 @@ void Emitter::emitParticle() {
         m_count++;
         return;
     }
+
+    //踩拍发射：间隔已满，等待本帧内出现节拍
+    const QSharedPointer<const BeatMap> beatMap = m_beatMap ? m_beatMap->get() : QSharedPointer<const BeatMap>();
+    const bool synced = beatMap && m_position >= 0 && m_lastPosition >= 0;
+    if(synced && m_onBeat && !beatMap->beatBetween(m_lastPosition, m_position))
+    {
+        return;
+    }
     m_count = 0;
-    for (int i = 0; i < m_quantity; ++i) {
-        auto params = generateParams();
-        Particle* p = m_factory(params);
-        if(FlameParticle *flame = dynamic_cast<FlameParticle*>(p))
-        {
-            flame->setScene(m_scene);
-            m_scene->addItem(flame);
-        }
-        else {
-            m_scene->addItem(p);
-        }
+    if(m_lutDirty)
+    {
+        bakeLifetimeLut();
+    }
+    int quantity = m_quantity;
+    if(synced && m_energyGain != 0)
+    {
+        quantity = std::max(0, qRound(m_quantity * (1.0 + m_energyGain * beatMap->energy(m_band, m_position))));
+    }
+    ShowStats::spawned(m_owner, ShowStats::Emitted, quantity);
+    for (int i = 0; i < quantity; ++i) {
+        m_scene->addItem(createParticle(generateParams()));
+    }
+}
+
+Particle *Emitter::createParticle(const ParticleParams &params)
+{
+    Particle* p = m_factory(params);
+    if(m_lut)
+    {
+        p->setLifetimeLut(m_lut);
+    }
+    p->setOwner(m_owner);
+    p->setEmitter(this);
+    //由粒子层绘制的粒子从加入场景起就不自行绘制
+    if(m_owner && m_owner->particleLayer())
+    {
+        p->setFlag(QGraphicsItem::ItemHasNoContents);
     }
+    return p;
 }
 
 
@@ -4,25 +4,57 @@
 #include <QGraphicsScene>
 #include <QTimer>
 #include "graphicsitems.h"
+#include "audioanalyzer.h"
+#include "emissionshape.h"
+#include "showstats.h"
 
 class Emitter : public QObject
 {
     Q_OBJECT
 public:
     using ParticleFactory = std::function<Particle*(const ParticleParams&)>;
+
+    //子发射器的触发事件
+    enum Trigger {
+        OnDeath,        //粒子死亡时
+        OnTick,         //每隔ticks个模拟步
+        OnAge           //年龄达到ticks时(一次)
+    };
     explicit Emitter(QGraphicsScene* scene,ParticleFactory factory, QObject* parent = nullptr);
 
     void setEmitingParams(int delay,int quantity,int interval); //发射参数，(发射延迟时间，一次发射量，发射间隔时间)
     void setPointRange(qreal minX,qreal maxX,qreal minY,qreal maxY);
+    void setEmissionShape(const EmissionShape &shape);              //按形状(图片/路径/文字)发射，空形状时恢复矩形范围
     void setVelocity(QVector2D direction,qreal minVelocity,qreal maxVelocity);
+    void setSpread(qreal degrees){m_spread = degrees;}             //方向在±degrees/2内随机偏转，360为全方向
     void setColor(const QColor &startColor,const QColor &endColor);
     void setSizeRange(qreal minSize,qreal maxSize);
     void setLifeTimeRange(int minLife,int maxLife);
+    void setColorCurve(const QGradientStops &stops);                //颜色随生命周期变化曲线
+    void setAlphaCurve(const LifetimeLut::Curve &curve);            //透明度随生命周期变化曲线(系数)
+    void setSizeCurve(const LifetimeLut::Curve &curve);             //尺寸随生命周期变化曲线(系数)
+    void bakeLifetimeLut();                                         //将曲线烘焙为查找表
+    void prewarm();                                                 //预热：烘焙查找表(含子发射器)，不访问场景
+    const QSharedPointer<const LifetimeLut> &lifetimeLut() const {return m_lut;}
+
+    //音乐同步：发射量随频段能量增加(quantity * (1 + energyGain * energy))，onBeat为true时发射间隔结束后等到下一拍才发射
+    void setBeatSync(const QSharedPointer<const BeatMapSlot> &beatMap, int band, qreal energyGain, bool onBeat = false);
+    void setMediaPosition(qint64 position);                         //每帧设置当前音乐位置(毫秒)
+    void setOwner(Screenwriter *owner);                             //发射的粒子归属的编剧(同时设置子发射器)
+
+    //子发射器像普通发射器一样配置(点范围为相对触发粒子位置的偏移，发射量取一次发射量)，由本发射器持有
+    void addSubEmitter(Emitter *emitter, Trigger trigger, int ticks = 0);
+    void raiseEvents(const Particle *particle, SpawnQueue *queue);     //演出中对本发射器的每个粒子调用，触发的子发射器把粒子放入队列
+    void emitAt(const QPointF &origin, SpawnQueue *queue, ShowStats::Spawn spawn = ShowStats::Emitted);
+
+    void saveState(QDataStream &out) const;                         //保存发射计数状态(用于快照)
+    void restoreState(QDataStream &in);
 
     void emitParticle();
 
 protected:
     virtual ParticleParams generateParams();
+    Particle *createParticle(const ParticleParams &params);
 
 
 
@@ -34,6 +66,8 @@ protected:
     qreal min_v;                //速度最小值
     qreal max_v;                //速度最大值
     QVector2D v_direction;      //运动方向
+    qreal m_spread = 0;         //方向随机偏转范围(度)
+    EmissionShape m_shape;      //发射形状(非空时代替矩形范围)
 
     QColor m_startColor;        //粒子初始颜色
     QColor m_endColor;          //粒子结束颜色
@@ -44,14 +78,36 @@ protected:
     int min_lifeTime;           //最小生命周期
     int max_lifeTime;           //最大生命周期
 
+    QGradientStops m_colorCurve;        //颜色曲线
+    LifetimeLut::Curve m_alphaCurve;    //透明度曲线
+    LifetimeLut::Curve m_sizeCurve;     //尺寸曲线
+    QSharedPointer<const LifetimeLut> m_lut;
+    bool m_lutDirty = true;
+
     QGraphicsScene* m_scene;
     ParticleFactory m_factory;
+    Screenwriter *m_owner = nullptr;
 
     int m_delay;
     int m_quantity;
     int m_interval;
 
     int m_count = 0;
+
+    QSharedPointer<const BeatMapSlot> m_beatMap;   //分析完成前为空图
+    int m_band = BeatMap::Bass;
+    qreal m_energyGain = 0;
+    bool m_onBeat = false;
+    qint64 m_lastPosition = -1;
+    qint64 m_position = -1;
+
+    struct SubEmitter
+    {
+        Emitter *emitter;
+        Trigger trigger;
+        int ticks;
+    };
+    QVector<SubEmitter> m_subEmitters;
 };
 
 
@@ -0,0 +1,98 @@
+#include "flowfield.h"
+#include <QtMath>
+
+namespace {
+
+quint32 latticeHash(quint32 x, quint32 y, quint32 z, quint32 seed)
+{
+    quint32 h = seed ^ (x * 0x8da6b343u) ^ (y * 0xd8163841u) ^ (z * 0xcb1ab31fu);
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return h;
+}
+
+//晶格值取[-1,1]
+float latticeValue(int x, int y, int z, int period, int timePeriod, quint32 seed)
+{
+    const quint32 ix = quint32(((x % period) + period) % period);
+    const quint32 iy = quint32(((y % period) + period) % period);
+    const quint32 iz = quint32(((z % timePeriod) + timePeriod) % timePeriod);
+    return latticeHash(ix, iy, iz, seed) / 4294967295.0f * 2.0f - 1.0f;
+}
+
+float smootherStep(float t)
+{
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+//周期性三维值噪声
+float periodicNoise(float u, float v, float w, int period, int timePeriod, quint32 seed)
+{
+    const int x0 = qFloor(u);
+    const int y0 = qFloor(v);
+    const int z0 = qFloor(w);
+    const float tx = smootherStep(u - x0);
+    const float ty = smootherStep(v - y0);
+    const float tz = smootherStep(w - z0);
+
+    float layers[2];
+    for (int k = 0; k < 2; ++k) {
+        const float v00 = latticeValue(x0,     y0,     z0 + k, period, timePeriod, seed);
+        const float v10 = latticeValue(x0 + 1, y0,     z0 + k, period, timePeriod, seed);
+        const float v01 = latticeValue(x0,     y0 + 1, z0 + k, period, timePeriod, seed);
+        const float v11 = latticeValue(x0 + 1, y0 + 1, z0 + k, period, timePeriod, seed);
+        const float top = v00 + (v10 - v00) * tx;
+        const float bottom = v01 + (v11 - v01) * tx;
+        layers[k] = top + (bottom - top) * ty;
+    }
+    return layers[0] + (layers[1] - layers[0]) * tz;
+}
+
+}
+
+FlowField FlowField::curlNoise(int size, int frames, int period, quint32 seed)
+{
+    FlowField field;
+    field.m_size = int(qNextPowerOfTwo(quint32(std::max(size, 2) - 1)));
+    field.m_frames = std::max(frames, 1);
+    period = std::max(period, 1);
+    const int timePeriod = std::max(field.m_frames / 4, 1);
+    const int n = field.m_size;
+
+    //势函数：两个倍频叠加，周期均能整除网格，保证平铺无缝
+    QVector<float> potential(n * n);
+    field.m_vectors.resize(n * n * field.m_frames);
+    float maxLength = 0;
+    for (int f = 0; f < field.m_frames; ++f) {
+        const float w = float(f) * timePeriod / field.m_frames;
+        for (int y = 0; y < n; ++y) {
+            for (int x = 0; x < n; ++x) {
+                const float u = float(x) * period / n;
+                const float v = float(y) * period / n;
+                potential[y * n + x] = periodicNoise(u, v, w, period, timePeriod, seed)
+                                     + 0.5f * periodicNoise(2 * u, 2 * v, w, 2 * period, timePeriod, seed + 1);
+            }
+        }
+
+        //旋度：(∂ψ/∂y, -∂ψ/∂x)
+        QVector2D *vectors = field.m_vectors.data() + f * n * n;
+        for (int y = 0; y < n; ++y) {
+            for (int x = 0; x < n; ++x) {
+                const float dx = potential[y * n + ((x + 1) & (n - 1))] - potential[y * n + ((x - 1) & (n - 1))];
+                const float dy = potential[((y + 1) & (n - 1)) * n + x] - potential[((y - 1) & (n - 1)) * n + x];
+                const QVector2D curl(dy * 0.5f, -dx * 0.5f);
+                vectors[y * n + x] = curl;
+                maxLength = std::max(maxLength, curl.length());
+            }
+        }
+    }
+
+    if(maxLength > 0)
+    {
+        for (QVector2D &vector : field.m_vectors) {
+            vector /= maxLength;
+        }
+    }
+    return field;
+}
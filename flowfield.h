@@ -0,0 +1,27 @@
+#ifndef FLOWFIELD_H
+#define FLOWFIELD_H
+
+#include <QVector2D>
+#include <QVector>
+
+//流场
+//预先计算的可平铺(空间与时间均首尾相接)旋度噪声网格，速度场无散度，粒子沿其运动呈现连贯的涡旋
+class FlowField
+{
+public:
+    FlowField() = default;
+
+    //size为网格边长(向上取2的幂)，frames为时间帧数，period为一个平铺周期内的噪声晶格数
+    static FlowField curlNoise(int size = 64, int frames = 16, int period = 4, quint32 seed = 1);
+
+    int size() const {return m_size;}
+    int frames() const {return m_frames;}
+    const QVector2D *frame(int index) const {return m_vectors.constData() + index * m_size * m_size;}
+
+private:
+    int m_size = 0;
+    int m_frames = 0;
+    QVector<QVector2D> m_vectors;   //按帧连续存储，每帧size*size个向量，模长已归一化到[0,1]
+};
+
+#endif // FLOWFIELD_H
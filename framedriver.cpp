@@ -0,0 +1,149 @@
+#include "framedriver.h"
+#include "showstats.h"
+
+#include <QDebug>
+#include <QEvent>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QTimer>
+#include <QWidget>
+#include <QWindow>
+
+FrameDriver::FrameDriver(QObject *parent)
+    : QObject(parent)
+{
+    m_timer = new QTimer(this);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    m_timer->setSingleShot(true);
+    connect(m_timer,&QTimer::timeout,this,&FrameDriver::onTimeout);
+    m_clock.start();
+}
+
+void FrameDriver::setWidget(QWidget *widget)
+{
+    m_widget = widget;
+    //重新选择驱动方式
+    if(m_active)
+    {
+        stop();
+        start();
+    }
+}
+
+qreal FrameDriver::refreshRate() const
+{
+    if(m_widget && m_widget->screen() && m_widget->screen()->refreshRate() > 1.0)
+    {
+        return m_widget->screen()->refreshRate();
+    }
+    return DEFAULT_REFRESH_RATE;
+}
+
+void FrameDriver::start()
+{
+    if(m_active)
+    {
+        return;
+    }
+    m_active = true;
+    m_period = qRound64(1e9 / refreshRate());
+    m_lastFrame = -1;
+    m_reportFrames = 0;
+    m_reportMissed = 0;
+    m_worstInterval = 0;
+    m_reportClock.start();
+
+    //合成器帧回调
+    QWindow *window = m_widget ? m_widget->window()->windowHandle() : nullptr;
+    if(window && QGuiApplication::platformName().startsWith("wayland"))
+    {
+        m_window = window;
+        m_window->installEventFilter(this);
+        m_window->requestUpdate();
+        return;
+    }
+    m_nextDeadline = m_clock.nsecsElapsed();
+    scheduleNext();
+}
+
+void FrameDriver::stop()
+{
+    m_active = false;
+    m_timer->stop();
+    if(m_window)
+    {
+        m_window->removeEventFilter(this);
+        m_window = nullptr;
+    }
+}
+
+//UpdateRequest同时用于窗口自身的重绘，这里只旁听，不拦截
+bool FrameDriver::eventFilter(QObject *watched, QEvent *event)
+{
+    if(m_active && watched == m_window && event->type() == QEvent::UpdateRequest)
+    {
+        deliver();
+        if(m_active && m_window)
+        {
+            m_window->requestUpdate();
+        }
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+void FrameDriver::onTimeout()
+{
+    deliver();
+    if(m_active && !m_window)
+    {
+        scheduleNext();
+    }
+}
+
+//下一帧的理想时刻按周期递推，定时器误差不会累积
+void FrameDriver::scheduleNext()
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    m_nextDeadline += m_period;
+    if(m_nextDeadline <= now)
+    {
+        m_nextDeadline = now + m_period - (now - m_nextDeadline) % m_period;
+    }
+    m_timer->start(int((m_nextDeadline - now + 999999) / 1000000));
+}
+
+void FrameDriver::deliver()
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    if(m_lastFrame >= 0)
+    {
+        //间隔超过1.5个周期即视为丢帧
+        const qint64 interval = now - m_lastFrame;
+        const qint64 missed = (interval + m_period / 2) / m_period - 1;
+        if(missed > 0)
+        {
+            m_missedFrames += missed;
+            m_reportMissed += missed;
+            ShowStats::global()->framesMissed(int(missed));
+        }
+        m_worstInterval = std::max(m_worstInterval, interval);
+    }
+    m_lastFrame = now;
+    m_frameCount++;
+    m_reportFrames++;
+
+    emit frame(now);
+
+    if(m_reportClock.elapsed() >= FRAME_REPORT_INTERVAL)
+    {
+        if(m_reportMissed > 0)
+        {
+            qDebug() << "帧统计: 帧数" << m_reportFrames << "丢帧" << m_reportMissed
+                     << "最长间隔(ms)" << m_worstInterval / 1e6 << "刷新率" << 1e9 / m_period;
+        }
+        m_reportFrames = 0;
+        m_reportMissed = 0;
+        m_worstInterval = 0;
+        m_reportClock.restart();
+    }
+}
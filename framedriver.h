@@ -0,0 +1,65 @@
+#ifndef FRAMEDRIVER_H
+#define FRAMEDRIVER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QPointer>
+
+#define DEFAULT_REFRESH_RATE 60.0       //无法取得屏幕刷新率时使用
+#define FRAME_REPORT_INTERVAL 10000     //帧统计输出间隔(毫秒)
+
+class QTimer;
+class QWidget;
+class QWindow;
+
+//帧驱动：按显示器刷新率发出frame信号
+//支持合成器帧回调的平台(Wayland)用QWindow::requestUpdate()跟随垂直同步，其余平台用精确单次定时器，
+//每次按理想时刻(起点 + n * 刷新周期)重新计时，避免20ms粗定时器与60Hz刷新拍频造成的16/33ms交替抖动，
+//同时统计实际帧间隔并报告丢帧
+class FrameDriver : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FrameDriver(QObject *parent = nullptr);
+
+    void setWidget(QWidget *widget);            //显示窗口，用于取得刷新率与帧回调
+    void start();
+    void stop();
+    bool isActive() const {return m_active;}
+
+    qreal refreshRate() const;
+    qint64 framePeriod() const {return m_period;}           //纳秒
+    qint64 frameCount() const {return m_frameCount;}
+    qint64 missedFrames() const {return m_missedFrames;}
+
+signals:
+    void frame(qint64 timestamp);               //单调时间戳(纳秒)
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+    void onTimeout();
+
+private:
+    void scheduleNext();
+    void deliver();
+
+    QPointer<QWidget> m_widget;
+    QPointer<QWindow> m_window;                 //使用帧回调时监听的窗口
+    QTimer *m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_period = 0;
+    qint64 m_nextDeadline = 0;
+    qint64 m_lastFrame = -1;
+    bool m_active = false;
+
+    qint64 m_frameCount = 0;
+    qint64 m_missedFrames = 0;
+    qint64 m_reportFrames = 0;                  //本统计周期内的帧数与丢帧数
+    qint64 m_reportMissed = 0;
+    qint64 m_worstInterval = 0;
+    QElapsedTimer m_reportClock;
+};
+
+#endif // FRAMEDRIVER_H
@@ -1,8 +1,15 @@
 #include "graphicsitems.h"
 #include <QPainter>
 #include <QGraphicsScene>
-#include <QRandomGenerator>
+#include "simrandom.h"
+#include "showstats.h"
+#include "splat.h"
+#include "screenwriter.h"
 #include <QGraphicsSceneMouseEvent>
+#include <QDataStream>
+#include <QHash>
+#include <QMutex>
+#include <algorithm>
 
 
 QColor GraphicsItem::gradientColor(const QColor &color1, const QColor &color2, int step, int n)
@@ -35,85 +42,219 @@ QPointF GraphicsItem::calculateParabolaTrack(QPointF startPoint, int vx, int vy,
     return point;
 }
 
+QDataStream &operator<<(QDataStream &out, const ParticleParams &params)
+{
+    out << params.position << params.speed << params.direction << params.velocity
+        << params.startColor << params.endColor << params.size << qint32(params.lifeTime);
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, ParticleParams &params)
+{
+    qint32 lifeTime;
+    in >> params.position >> params.speed >> params.direction >> params.velocity
+       >> params.startColor >> params.endColor >> params.size >> lifeTime;
+    params.lifeTime = lifeTime;
+    return in;
+}
+
 //------------------------------------------------------------------------------------------------
 
 Particle::Particle(const ParticleParams &params, QGraphicsItem *parent)
     : QGraphicsObject(parent)
-    , m_params(params)
-    , m_age(0)
-    , m_delay(0)
+    , m_state(ParticleState::fromParams(params))
+    , m_lutScale(0)
     , m_orthometricAmplitude(0)
     , m_parallelAmplitude(0)
     , m_frequency(0)
-    , m_phase(QRandomGenerator::global()->bounded(2*M_PI))
+    , m_phase(ParticleReal(SimRandom::global()->bounded(2*M_PI)))
 {
     setPos(params.position);
-    // 设置素材图片
-    QPixmap image(":/ball.png");
-    m_pixmap = image.scaled(params.size,params.size,Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+QImage Particle::sprite(int size)
+{
+    static QMutex mutex;
+    static QImage source;
+    static QHash<int, QImage> sprites;
+    size = std::max(1, size);
+    QMutexLocker locker(&mutex);
+    auto it = sprites.constFind(size);
+    if(it != sprites.constEnd())
+    {
+        return it.value();
+    }
+    if(source.isNull())
+    {
+        source = QImage(":/ball.png").convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+    const QImage image = source.scaled(size, size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    ShowStats::global()->addBytes(ShowStats::ParticleSprites, image.sizeInBytes());
+    sprites.insert(size, image);
+    return image;
+}
+
+Particle *Particle::create(int type, const ParticleParams &params)
+{
+    switch (type) {
+    case LampParticle::Type:
+        return new LampParticle(params);
+    case FlameParticle::Type:
+        return new FlameParticle(params);
+    case FireworkParticle::Type:
+        return new FireworkParticle(params);
+    default:
+        return new Particle(params);
+    }
+}
+
+void Particle::saveState(QDataStream &out) const
+{
+    out << qint32(m_state.age) << qint32(m_state.delay)
+        << qreal(m_orthometricAmplitude) << qreal(m_parallelAmplitude) << qreal(m_frequency) << qreal(m_phase)
+        << pos() << zValue();
+}
+
+void Particle::restoreState(QDataStream &in)
+{
+    qint32 age, delay;
+    qreal orthometricAmplitude, parallelAmplitude, frequency, phase;
+    QPointF position;
+    qreal z;
+    in >> age >> delay
+       >> orthometricAmplitude >> parallelAmplitude >> frequency >> phase
+       >> position >> z;
+    m_state.age = quint16(qBound(0, age, 0xffff));
+    m_state.delay = quint16(qBound(0, delay, 0xffff));
+    m_orthometricAmplitude = ParticleReal(orthometricAmplitude);
+    m_parallelAmplitude = ParticleReal(parallelAmplitude);
+    m_frequency = ParticleReal(frequency);
+    m_phase = ParticleReal(phase);
+    setPos(position);
+    m_state.mx = 0;
+    m_state.my = 0;
+    setZValue(z);
 }
 
 void Particle::updatePaint()
 {
-    QVector2D direction = m_params.direction.normalized();
-    QVector2D normal(direction.y(),-direction.x()); //粒子运动方向的法向量
-    QVector2D displacement = normal * m_orthometricAmplitude * qCos(m_frequency * m_age + m_phase);     //计算粒子正交方向振动的位移向量
-    QVector2D displacement2 = direction * m_parallelAmplitude *qSin(m_frequency * m_age + m_phase);     //计算粒子平行方向振动的位移向量
-    QPointF newPos = m_params.position + displacement.toPointF() + displacement2.toPointF();//振动中心点加上位移向量
+    //振动方向(dx,dy)的法向量为(dy,-dx)
+    const ParticleReal phase = m_frequency * m_state.age + m_phase;
+    const ParticleReal orthometric = m_orthometricAmplitude * qCos(phase);     //正交方向振动的位移
+    const ParticleReal parallel = m_parallelAmplitude * qSin(phase);          //平行方向振动的位移
+    const QPointF newPos(m_state.x + m_state.dy * orthometric + m_state.dx * parallel,
+                         m_state.y - m_state.dx * orthometric + m_state.dy * parallel);    //振动中心点加上位移
+    m_state.mx = ParticleReal(newPos.x() - pos().x());
+    m_state.my = ParticleReal(newPos.y() - pos().y());
     setPos(newPos);
-    if(m_delay <= 0)
+    if(m_state.delay == 0)
     {
-        m_age++;
+        if(m_state.age < 0xffff)
+        {
+            m_state.age++;
+        }
     }
     else {
-        m_delay--;
+        m_state.delay--;
     }
-    m_params.position  += m_params.velocity.toPointF();
+    m_state.x += m_state.vx;
+    m_state.y += m_state.vy;
 }
 
 void Particle::setVibration(qreal orthometricAmplitude, qreal parallelAmplitude, qreal frequency, bool randomPhase, qreal phase)
 {
-    m_orthometricAmplitude = orthometricAmplitude;
-    m_parallelAmplitude = parallelAmplitude;
-    m_frequency = frequency;
+    m_orthometricAmplitude = ParticleReal(orthometricAmplitude);
+    m_parallelAmplitude = ParticleReal(parallelAmplitude);
+    m_frequency = ParticleReal(frequency);
     if(!randomPhase)
     {
-        m_phase = phase;
+        m_phase = ParticleReal(phase);
     }
 }
 
-//重写绘图范围函数
+void Particle::setLifetimeLut(const QSharedPointer<const LifetimeLut> &lut)
+{
+    prepareGeometryChange();
+    m_lut = lut;
+    m_lutScale = float(LifetimeLut::Resolution - 1) / std::max(1, int(m_state.lifeTime));
+}
+
+//重写绘图范围函数(有尺寸曲线时取曲线最大值)
 QRectF Particle::boundingRect() const
 {
-    return QRectF(-m_params.size/2, -m_params.size/2, m_params.size, m_params.size);
+    const qreal size = m_lut ? m_state.size * m_lut->maxSize() : m_state.size;
+    return QRectF(-size/2, -size/2, size, size);
+}
+
+QRectF Particle::currentRect() const
+{
+    if(!m_lut)
+    {
+        return boundingRect();
+    }
+    const qreal size = m_state.size * m_lut->size(lutIndex());
+    return QRectF(-size/2, -size/2, size, size);
 }
 
 //重写绘图过程
 void Particle::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
 {
-    if(m_delay > 0)
+    ShowStats::global()->paintCall();
+    if(m_state.delay > 0)
     {
         return;
     }
     QColor color = interpolateColor();
+    if(Splat::paint(painter, currentRect(), color, Splat::Alpha))
+    {
+        return;
+    }
 
     painter->setBrush(color);
     painter->setPen(Qt::NoPen);
-    painter->drawEllipse(boundingRect());
+    painter->drawEllipse(currentRect());
     //painter->setCompositionMode(QPainter::CompositionMode_Overlay);
-    //painter->drawPixmap(boundingRect(), m_pixmap, m_pixmap.rect());
+    //painter->drawImage(boundingRect(), sprite(int(m_state.size)));
 }
 
-//渐变颜色计算
+bool Particle::record(ParticleRecord *record) const
+{
+    if(m_state.delay > 0)
+    {
+        return false;
+    }
+    record->rect = currentRect().translated(pos());
+    record->motion = QPointF(m_state.mx, m_state.my);
+    record->color = premultipliedColor();
+    record->sprite = false;
+    return true;
+}
+
+//渐变颜色计算(有查找表时直接查表)
+//在预乘空间内按8位定点逐通道插值，透明度曲线对四个通道同比缩放
+QRgb Particle::premultipliedColor() const
+{
+    if(m_lut && m_lut->hasColor())
+    {
+        return m_lut->premultiplied(lutIndex());
+    }
+    const int ratio = m_state.lifeTime > 0 ? std::min(256, (m_state.age << 8) / m_state.lifeTime) : 256;
+    const int scale = m_lut ? std::max(0, int(m_lut->alpha(lutIndex()) * 256)) : 256;
+    int channels[4];
+    for (int i = 0; i < 4; ++i) {
+        const int shift = 8 * i;
+        const int from = (m_state.startColor >> shift) & 0xff;
+        const int to = (m_state.endColor >> shift) & 0xff;
+        channels[i] = (from + (to - from) * ratio / 256) * scale / 256;
+    }
+    const int alpha = std::min(channels[3], 255);         //缩放后保证颜色分量不超过透明度
+    return qRgba(std::min(channels[2], alpha), std::min(channels[1], alpha), std::min(channels[0], alpha), alpha);
+}
+
+//QPainter回退绘制用的非预乘颜色
 QColor Particle::interpolateColor() const
 {
-    qreal ratio = static_cast<qreal>(m_age) / m_params.lifeTime;
-    return QColor::fromRgbF(
-        m_params.startColor.redF()   + (m_params.endColor.redF()   - m_params.startColor.redF())   * ratio,
-        m_params.startColor.greenF() + (m_params.endColor.greenF() - m_params.startColor.greenF()) * ratio,
-        m_params.startColor.blueF()  + (m_params.endColor.blueF()  - m_params.startColor.blueF())  * ratio,
-        m_params.startColor.alphaF() + (m_params.endColor.alphaF() - m_params.startColor.alphaF()) * ratio
-        );
+    return QColor::fromRgba(qUnpremultiply(premultipliedColor()));
 }
 
 
@@ -129,9 +270,9 @@ QColor Particle::interpolateColor() const
 LampParticle::LampParticle(const ParticleParams &params, QGraphicsItem *parent)
     : Particle(params,parent)
     , m_flickerFrequency(2)
-    , m_flickerPhase(QRandomGenerator::global()->bounded(M_PI * 2))
+    , m_flickerPhase(SimRandom::global()->bounded(M_PI * 2))
     , m_flickerProgress(0)
-    , m_pulseIntensity(0.5 + QRandomGenerator::global()->bounded(0.5)) // 随机脉冲强度
+    , m_pulseIntensity(0.5 + SimRandom::global()->bounded(0.5)) // 随机脉冲强度
 {
 
 }
@@ -153,18 +294,53 @@ void LampParticle::updatePaint()
     Particle::updatePaint();
 }
 
-void LampParticle::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+void LampParticle::saveState(QDataStream &out) const
+{
+    Particle::saveState(out);
+    out << qint32(m_flickerFrequency) << m_flickerPhase << m_flickerProgress << m_pulseIntensity;
+}
+
+void LampParticle::restoreState(QDataStream &in)
+{
+    Particle::restoreState(in);
+    qint32 frequency;
+    in >> frequency >> m_flickerPhase >> m_flickerProgress >> m_pulseIntensity;
+    m_flickerFrequency = frequency;
+}
+
+QColor LampParticle::flickerColor() const
 {
     QColor color = interpolateColor();
     // 计算闪烁颜色
     QColor flickerColor = color.lighter(100 + m_flickerProgress * 50); // 亮度变化
     flickerColor.setAlphaF(color.alphaF() * (0.5 + m_flickerProgress * 0.5)); // 透明度变
+    return flickerColor;
+}
 
+bool LampParticle::record(ParticleRecord *record) const
+{
+    record->rect = currentRect().translated(pos());
+    record->motion = QPointF(m_state.mx, m_state.my);
+    record->color = qPremultiply(flickerColor().rgba());         //闪烁的增亮在HSV空间计算，仍需经过QColor
+    record->sprite = true;
+    return true;
+}
+
+void LampParticle::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+{
+    ShowStats::global()->paintCall();
+    const QRectF rect = currentRect();
+    //目标为光栅图像时光斑贴图用径向衰减的白色叠加代替
+    if(Splat::paint(painter, rect, flickerColor(), Splat::Alpha))
+    {
+        Splat::paint(painter, rect, Qt::white, Splat::Overlay, 1.0);
+        return;
+    }
     painter->setPen(Qt::NoPen);
-    painter->setBrush(flickerColor);
-    painter->drawEllipse(boundingRect());
+    painter->setBrush(flickerColor());
+    painter->drawEllipse(rect);
     painter->setCompositionMode(QPainter::CompositionMode_Overlay);
-    painter->drawPixmap(boundingRect(), m_pixmap, m_pixmap.rect());
+    painter->drawImage(rect, sprite(int(m_state.size)));
 
 }
 
@@ -181,36 +357,55 @@ void FlameParticle::updatePaint()
     }
 
     //执行爆炸
-    if(m_explode && (m_age >= m_params.lifeTime))
+    if(m_explode && isDead())
     {
         exploding();
     }
 
 }
 
+void FlameParticle::saveState(QDataStream &out) const
+{
+    LampParticle::saveState(out);
+    out << m_splash << m_explode;
+}
+
+void FlameParticle::restoreState(QDataStream &in)
+{
+    LampParticle::restoreState(in);
+    in >> m_splash >> m_explode;
+}
+
 void FlameParticle::splashing()
 {
+    if(m_trail)
+    {
+        m_trail->stamp(this->pos(), 0.4 * m_state.size, startColor().lighter());
+        return;
+    }
     ParticleParams params;
     params.position = this->pos();              //当前位置
-    params.direction = - m_params.direction;    //反方向
-    params.speed = QRandomGenerator::global()->bounded(0.2);    //速度随机0~0.5;
+    params.direction = - direction();           //反方向
+    params.speed = SimRandom::global()->bounded(0.2);    //速度随机0~0.5;
     params.velocity = params.speed * params.direction;
-    params.startColor = m_params.startColor.lighter();          //当前颜色
-    params.endColor = m_params.startColor;                      //结束颜色
-    params.size = QRandomGenerator::global()->bounded(0.2 * m_params.size);
-    params.lifeTime = m_params.lifeTime - m_age;
+    params.startColor = startColor().lighter();                 //当前颜色
+    params.endColor = startColor();                             //结束颜色
+    params.size = SimRandom::global()->bounded(0.2 * m_state.size);
+    params.lifeTime = m_state.lifeTime - m_state.age;
     LampParticle* p = new LampParticle(params);
     p->setVibration(5,5,0.01);
     p->setFlickerFrequency(20);
-    m_scene->addItem(p);
+    ShowStats::spawned(owner(), ShowStats::Splashed);
+    spawn(p);
 }
 
 void FlameParticle::exploding()
 {
-    qreal explodingRadius = 20.0 + QRandomGenerator::global()->bounded(30.0);
+    ShowStats::spawned(owner(), ShowStats::Exploded, 30);
+    qreal explodingRadius = 20.0 + SimRandom::global()->bounded(30.0);
     for (int i = 0; i < 30; ++i) {
-        qreal radian = QRandomGenerator::global()->bounded(2 * M_PI);
-        qreal length = QRandomGenerator::global()->bounded(explodingRadius);
+        qreal radian = SimRandom::global()->bounded(2 * M_PI);
+        qreal length = SimRandom::global()->bounded(explodingRadius);
         QVector2D offset(length * qCos(radian),length * qSin(radian));
         QPointF point = this->pos() + offset.toPointF();
 
@@ -219,20 +414,32 @@ void FlameParticle::exploding()
         params.direction = offset.normalized();     //随机方向
         params.speed = 0;                           //速度随机0~0.5;
         params.velocity = params.speed * params.direction;
-        params.startColor = m_params.endColor.darker();             //当前颜色
-        params.endColor = m_params.endColor.lighter();             //结束颜色
-        params.size = 1.5 + QRandomGenerator::global()->bounded(1.5);
-        params.lifeTime = 5 + QRandomGenerator::global()->bounded(5);
+        params.startColor = endColor().darker();                    //当前颜色
+        params.endColor = endColor().lighter();                     //结束颜色
+        params.size = 1.5 + SimRandom::global()->bounded(1.5);
+        params.lifeTime = 5 + SimRandom::global()->bounded(5);
         Particle* p = new Particle(params);
-        p->setDelay(QRandomGenerator::global()->bounded(40));
-        m_scene->addItem(p);
+        p->setDelay(SimRandom::global()->bounded(40));
+        spawn(p);
     }
 }
 
 
+void FlameParticle::spawn(Particle *particle)
+{
+    if(!owner())
+    {
+        delete particle;
+        return;
+    }
+    particle->setOwner(owner());
+    owner()->spawnQueue().push(particle);
+}
+
 void FireworkParticle::exploding()
 {
-    int lifeTime = 30 + QRandomGenerator::global()->bounded(10);
+    ShowStats::spawned(owner(), ShowStats::Exploded, 60);
+    int lifeTime = 30 + SimRandom::global()->bounded(10);
     for (int i = 0; i < 30; ++i) {
         qreal radian = i * 2 * M_PI / 30;
         QVector2D v = calculateHeartPosition(radian);
@@ -241,15 +448,15 @@ void FireworkParticle::exploding()
         params.direction = v.normalized();     //随机方向
         params.speed = v.length();
         params.velocity = params.speed * params.direction;
-        params.startColor = m_params.startColor.lighter();        //当前颜色
-        params.endColor = m_params.endColor;                      //结束颜色
-        params.size = 0.5 * m_params.size;
+        params.startColor = startColor().lighter();               //当前颜色
+        params.endColor = endColor();                             //结束颜色
+        params.size = 0.5 * m_state.size;
         params.lifeTime = lifeTime;
         FlameParticle* p = new FlameParticle(params);
         p->setFlickerFrequency(20);
         p->setExplodeParams(true,false);
-        p->setScene(m_scene);
-        m_scene->addItem(p);
+        p->setTrailLayer(m_trail);
+        spawn(p);
     }
     for (int i = 0; i < 30; ++i) {
         qreal radian = i * 2 * M_PI / 30;
@@ -260,14 +467,14 @@ void FireworkParticle::exploding()
         params.direction = v.normalized();     //随机方向
         params.speed = 0.4 * v.length();
         params.velocity = params.speed * params.direction;
-        params.startColor = m_params.startColor.lighter();        //当前颜色
-        params.endColor = m_params.startColor;                      //结束颜色
-        params.size = 0.2 * m_params.size;
+        params.startColor = startColor().lighter();               //当前颜色
+        params.endColor = startColor();                             //结束颜色
+        params.size = 0.2 * m_state.size;
         params.lifeTime = lifeTime;
         FlameParticle* p = new FlameParticle(params);
         p->setExplodeParams(true,true);
-        p->setScene(m_scene);
-        m_scene->addItem(p);
+        p->setTrailLayer(m_trail);
+        spawn(p);
     }
 }
 
@@ -281,6 +488,332 @@ QVector2D FireworkParticle::calculateHeartPosition(qreal angle) const
 
 //-------------------------------------------------------------------------------------------
 
+TrailLayer::TrailLayer(const QRectF &rect, qreal fade, QGraphicsItem *parent)
+    : QGraphicsObject(parent)
+    , m_rect(rect)
+    , m_image(rect.size().toSize(), QImage::Format_ARGB32_Premultiplied)
+    , m_fadeAlpha(qBound(0, qRound(fade * 255), 255))
+{
+    m_image.fill(Qt::transparent);
+    setPos(rect.topLeft());
+    ShowStats::global()->addBytes(ShowStats::LayerImages, m_image.sizeInBytes());
+}
+
+TrailLayer::~TrailLayer()
+{
+    ShowStats::global()->addBytes(ShowStats::LayerImages, -m_image.sizeInBytes());
+}
+
+void TrailLayer::stamp(const QPointF &point, qreal size, const QColor &color)
+{
+    m_stamps.append({mapFromScene(point), size, color});
+}
+
+void TrailLayer::advance()
+{
+    //整体淡出：预乘的四个通道乘以固定系数后向下取整，非零通道每帧至少减1，拖尾最终完全清除
+    //(DestinationIn按四舍五入混合，alpha不超过4的像素保持不变，会留下永久的残影)
+    const quint32 scale = quint32(m_fadeAlpha);
+    for (int y = 0; y < m_image.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb*>(m_image.scanLine(y));
+        for (int x = 0; x < m_image.width(); ++x) {
+            const QRgb pixel = line[x];
+            if(pixel == 0)
+            {
+                continue;
+            }
+            const quint32 rb = (((pixel & 0x00ff00ffu) * scale) >> 8) & 0x00ff00ffu;
+            const quint32 ag = (((pixel >> 8) & 0x00ff00ffu) * scale) & 0xff00ff00u;
+            line[x] = ag | rb;
+        }
+    }
+
+    //绘制本帧盖印
+    QPainter painter(&m_image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(Qt::NoPen);
+    for (const Stamp &stamp : std::as_const(m_stamps)) {
+        painter.setBrush(stamp.color);
+        painter.drawEllipse(stamp.point, stamp.size / 2, stamp.size / 2);
+    }
+    painter.end();
+    m_stamps.clear();
+    update();
+}
+
+QRectF TrailLayer::boundingRect() const
+{
+    return QRectF(QPointF(0,0), m_rect.size());
+}
+
+void TrailLayer::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+{
+    ShowStats::global()->paintCall();
+    painter->drawImage(0, 0, m_image);
+}
+
+//-------------------------------------------------------------------------------------------
+
+SpawnQueue::~SpawnQueue()
+{
+    qDeleteAll(m_particles);
+}
+
+void SpawnQueue::commit(QGraphicsScene *scene)
+{
+    for (Particle *particle : std::as_const(m_particles)) {
+        scene->addItem(particle);
+    }
+    m_particles.clear();
+}
+
+//-------------------------------------------------------------------------------------------
+
+ParticleLayer::ParticleLayer(const QRectF &rect, QGraphicsItem *parent)
+    : QGraphicsObject(parent)
+    , m_rect(rect)
+{
+    setPos(rect.topLeft());
+    m_pipeline.setMaxThreadCount(1);
+}
+
+ParticleLayer::~ParticleLayer()
+{
+    m_pipeline.waitForDone();
+    m_pool.waitForDone();
+    resizeImage(&m_image, QSize());
+    for (int i = 0; i < 3; ++i) {
+        resizeImage(&m_buffers.slot(i), QSize());
+    }
+}
+
+void ParticleLayer::clear()
+{
+    m_records.clear();
+}
+
+void ParticleLayer::append(Particle *particle, qreal opacity)
+{
+    if(!(particle->flags() & QGraphicsItem::ItemHasNoContents))
+    {
+        particle->setFlag(QGraphicsItem::ItemHasNoContents);
+    }
+    ParticleRecord record;
+    if(particle->record(&record))
+    {
+        record.rect.translate(-m_rect.topLeft());
+        record.opacity = float(qBound<qreal>(0, opacity, 1));
+        if(record.opacity < 1.0f)
+        {
+            //预乘颜色四个通道同比缩放
+            const uint scale = uint(record.opacity * 256);
+            const QRgb color = record.color;
+            record.color = qRgba((qRed(color) * scale) >> 8, (qGreen(color) * scale) >> 8, (qBlue(color) * scale) >> 8, (qAlpha(color) * scale) >> 8);
+        }
+        m_records.append(record);
+    }
+}
+
+void ParticleLayer::commit()
+{
+    m_dirty = true;
+    update();
+}
+
+void ParticleLayer::setInterpolation(qreal alpha)
+{
+    if(alpha != m_alpha)
+    {
+        m_alpha = alpha;
+        m_dirty = true;
+        update();
+    }
+}
+
+void ParticleLayer::setPipelined(bool pipelined)
+{
+    m_pipeline.waitForDone();
+    m_pipelined = pipelined;
+    m_dirty = true;
+    update();
+}
+
+void ParticleLayer::submit()
+{
+    if(!m_pipelined || !m_dirty)
+    {
+        return;
+    }
+
+    //上一帧的光栅化仍未完成时不等待，跳过本帧(记录保持待提交，下一帧提交更新的记录)，保证后台缓冲只有一个写者
+    if(m_rasterizing.load(std::memory_order_acquire))
+    {
+        return;
+    }
+    m_dirty = false;
+    m_rasterizing.store(true, std::memory_order_relaxed);
+    const QVector<ParticleRecord> records = m_records;
+    const qreal alpha = m_alpha;
+    const qreal scale = m_scale;
+    const QSize size = (m_rect.size() * scale).toSize();
+    m_pipeline.start([this, records, alpha, scale, size]() {
+        QImage &image = m_buffers.back();
+        resizeImage(&image, size);
+        rasterize(&image, records, alpha, scale);
+        m_buffers.publish();
+        m_rasterizing.store(false, std::memory_order_release);
+    });
+}
+
+//等待进行中的光栅化，本帧被跳过的记录再提交一次并等待，挂起前最后一帧不会停在旧内容上
+void ParticleLayer::flush()
+{
+    if(m_pipelined)
+    {
+        m_pipeline.waitForDone();
+        if(m_dirty)
+        {
+            submit();
+            m_pipeline.waitForDone();
+        }
+        update();
+    }
+}
+
+void ParticleLayer::resizeImage(QImage *image, const QSize &size)
+{
+    if(image->size() == size)
+    {
+        return;
+    }
+    ShowStats::global()->addBytes(ShowStats::LayerImages, -image->sizeInBytes());
+    *image = size.isEmpty() ? QImage() : QImage(size, QImage::Format_ARGB32_Premultiplied);
+    ShowStats::global()->addBytes(ShowStats::LayerImages, image->sizeInBytes());
+}
+
+//绘制位置落后一个模拟步，在上一步与本步之间插值
+QRectF ParticleLayer::recordRect(const ParticleRecord &record, qreal alpha)
+{
+    return record.rect.translated(-(1.0 - alpha) * record.motion);
+}
+
+QRectF ParticleLayer::boundingRect() const
+{
+    return QRectF(QPointF(0,0), m_rect.size());
+}
+
+//按设备分辨率光栅化(输出放大或缩小时粒子保持清晰)，只在有新记录时重新光栅化
+void ParticleLayer::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+{
+    const qreal scale = qMax<qreal>(0.1, painter->deviceTransform().m11());
+    ShowStats::global()->paintCall();
+    if(m_pipelined)
+    {
+        //取最近完成的一帧，缩放改变时下一次提交按新缩放光栅化
+        if(scale != m_scale)
+        {
+            m_scale = scale;
+            m_dirty = true;
+        }
+        m_buffers.update();
+        if(!m_buffers.front().isNull())
+        {
+            painter->drawImage(boundingRect(), m_buffers.front());
+        }
+        return;
+    }
+
+    const QSize size = (m_rect.size() * scale).toSize();
+    if(m_image.size() != size)
+    {
+        resizeImage(&m_image, size);
+        m_dirty = true;
+    }
+    if(m_dirty)
+    {
+        rasterize(&m_image, m_records, m_alpha, scale);
+        m_dirty = false;
+    }
+    painter->drawImage(boundingRect(), m_image);
+}
+
+void ParticleLayer::rasterize(QImage *image, const QVector<ParticleRecord> &records, qreal alpha, qreal scale)
+{
+    image->fill(Qt::transparent);
+    if(records.isEmpty())
+    {
+        return;
+    }
+
+    //按块分箱，块内保持记录顺序(即绘制顺序)
+    const int columns = (image->width() + PARTICLE_TILE - 1) / PARTICLE_TILE;
+    const int rows = (image->height() + PARTICLE_TILE - 1) / PARTICLE_TILE;
+    QVector<QVector<int>> bins(columns * rows);
+    for (int i = 0; i < records.count(); ++i) {
+        const QRectF rect = recordRect(records.at(i), alpha);
+        if(rect.right() < 0 || rect.bottom() < 0 || rect.left() * scale > image->width() || rect.top() * scale > image->height())
+        {
+            continue;
+        }
+        const int left = qBound(0, int(rect.left() * scale) / PARTICLE_TILE, columns - 1);
+        const int right = qBound(0, int(rect.right() * scale + 1) / PARTICLE_TILE, columns - 1);
+        const int top = qBound(0, int(rect.top() * scale) / PARTICLE_TILE, rows - 1);
+        const int bottom = qBound(0, int(rect.bottom() * scale + 1) / PARTICLE_TILE, rows - 1);
+        for (int y = top; y <= bottom; ++y) {
+            for (int x = left; x <= right; ++x) {
+                bins[y * columns + x].append(i);
+            }
+        }
+    }
+
+    //各块写入同一图像的不同区域，互不重叠，无需加锁
+    uchar *bits = image->bits();
+    const qsizetype bytesPerLine = image->bytesPerLine();
+    const bool parallel = records.count() >= PARALLEL_RASTER_MIN;
+    for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < columns; ++x) {
+            const QVector<int> &indices = bins.at(y * columns + x);
+            if(indices.isEmpty())
+            {
+                continue;
+            }
+            const QRect tile = QRect(x * PARTICLE_TILE, y * PARTICLE_TILE, PARTICLE_TILE, PARTICLE_TILE).intersected(image->rect());
+            if(parallel)
+            {
+                m_pool.start([bits, bytesPerLine, tile, &indices, &records, alpha, scale]() {
+                    rasterizeTile(bits, bytesPerLine, tile, indices, records, alpha, scale);
+                });
+            }
+            else
+            {
+                rasterizeTile(bits, bytesPerLine, tile, indices, records, alpha, scale);
+            }
+        }
+    }
+    m_pool.waitForDone();
+}
+
+void ParticleLayer::rasterizeTile(uchar *bits, qsizetype bytesPerLine, const QRect &tile, const QVector<int> &indices,
+                                  const QVector<ParticleRecord> &records, qreal alpha, qreal scale)
+{
+    //直接写入图像缓冲区，块范围即裁剪范围
+    ShowStats::global()->rasterized(indices.count());
+    for (int index : indices) {
+        const ParticleRecord &record = records.at(index);
+        const QRectF rect = recordRect(record, alpha);
+        const QPointF center = rect.center() * scale;
+        const qreal radius = rect.width() * scale / 2;
+        Splat::splat(bits, bytesPerLine, tile, center, radius, record.color, Splat::Alpha);
+        if(record.sprite)
+        {
+            const int white = qRound(255 * record.opacity);
+            Splat::splat(bits, bytesPerLine, tile, center, radius, qRgba(white, white, white, white), Splat::Overlay, 1.0);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+
 OrchidItem::OrchidItem(const QVector2D &point, const QVector2D &v, QGraphicsScene *scene, QGraphicsItem *parent)
     : QGraphicsObject(parent)
     , m_scene(scene)
@@ -288,7 +821,11 @@ OrchidItem::OrchidItem(const QVector2D &point, const QVector2D &v, QGraphicsScen
     this->setPos(point.x(),point.y());
     m_vx = v.x();
     m_vy = v.y();
-    m_boundingRect = QRectF(-960,-540,1920,1080);
+}
+
+OrchidItem::~OrchidItem()
+{
+    ShowStats::global()->addBytes(ShowStats::OrchidTracks, -qint64(track.capacity() * sizeof(Primitive)));
 }
 
 void OrchidItem::setOrchid(int length, const QColor &color1, const QColor &color2, float width1, float width2)
@@ -321,58 +858,107 @@ void OrchidItem::start()
         p.width = tempWidth;
         track.append(p);
     }
+
+    //轨迹占用计入内存统计，析构时扣除
+    ShowStats::global()->addBytes(ShowStats::OrchidTracks, qint64(track.capacity() * sizeof(Primitive)));
+
+    //包围盒取轨迹范围外扩最大线宽，与场景分辨率无关
+    QPolygonF points;
+    for (const Primitive &p : std::as_const(track)) {
+        points.append(p.point);
+    }
+    const qreal margin = std::max(m_width1, m_width2);
+    m_boundingRect = points.boundingRect().adjusted(-margin,-margin,margin,margin);
     m_scene->addItem(this);
 }
 
-void OrchidItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+void OrchidItem::updatePaint()
 {
     if(m_waitTime > 0)
     {
         m_waitTime--;
     }
+    else if(m_paintingTime > 0)
+    {
+        m_paintingTime--;
+        if(m_paintingTime == 0)
+        {
+            m_cache.invalidate();       //进入退场，线宽改变
+        }
+    }
+    else if(m_fadingTime > 1)
+    {
+        m_fadingTime--;
+        m_cache.invalidate();           //退场时线宽逐帧变化
+    }
     else
     {
+        m_finished = true;
+    }
+}
+
+void OrchidItem::saveState(QDataStream &out) const
+{
+    out << pos() << m_vx << m_vy << qint32(m_length)
+        << m_color1 << m_color2 << m_width1 << m_width2
+        << qint32(m_waitTime) << qint32(m_paintingTime) << qint32(m_fadingTime);
+}
+
+OrchidItem *OrchidItem::restore(QDataStream &in, QGraphicsScene *scene)
+{
+    QPointF position;
+    float vx, vy, width1, width2;
+    qint32 length, waitTime, paintingTime, fadingTime;
+    QColor color1, color2;
+    in >> position >> vx >> vy >> length
+       >> color1 >> color2 >> width1 >> width2
+       >> waitTime >> paintingTime >> fadingTime;
+
+    OrchidItem *orchid = new OrchidItem(QVector2D(position), QVector2D(vx,vy), scene);
+    orchid->setOrchid(length,color1,color2,width1,width2);
+    orchid->setPainting(waitTime,paintingTime,fadingTime);
+    orchid->start();
+    orchid->m_paintingTime = paintingTime;     //start()会将绘制时间补足到轨迹长度，恢复时以快照为准
+    return orchid;
+}
+
+//进度由updatePaint()按帧推进，绘制只反映当前状态
+void OrchidItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+{
+    ShowStats::global()->paintCall();
+    if(m_waitTime > 0 || m_finished)
+    {
+        return;
+    }
+    const bool fading = m_paintingTime <= 0;       //退场时绘制全部线段
+    int paintCount = track.count() - 1;
+    if(!fading)
+    {
+        paintCount = std::min<int>(track.count() - m_paintingTime, track.count() - 1);
+        if(paintCount <= 0)
+        {
+            return;
+        }
+    }
+
+    auto drawSegments = [this, fading](QPainter *painter, int from, int to) {
         QPen pen;
         pen.setStyle(Qt::SolidLine);
         pen.setCapStyle(Qt::RoundCap);
         pen.setJoinStyle(Qt::RoundJoin);
-        if(m_paintingTime > 0)
-        {
-            m_paintingTime--;
-            int paintCount = track.count() - m_paintingTime;
-            if(paintCount > 0)
-            {
-                if(paintCount >= track.count())
-                {
-                    paintCount = track.count() - 1;
-                }
-                for (int i = 0; i < paintCount; ++i) {
-                    pen.setColor(track.at(i).color);
-                    pen.setWidthF(track.at(i).width);
-                    painter->setPen(pen);
-                    painter->drawLine(track.at(i).point,track.at(i+1).point);
-                }
-            }
+        for (int i = from; i < to; ++i) {
+            pen.setColor(track.at(i).color);
+            pen.setWidthF(fading ? track.at(i).width - track.at(i).width/m_fadingTime : track.at(i).width);
+            painter->setPen(pen);
+            painter->drawLine(track.at(i).point,track.at(i+1).point);
         }
-        else
-        {
-            if(m_fadingTime > 1) //执行退场绘制
-            {
-                m_fadingTime--;
-                for (int i = 0; i < track.count() - 1; ++i) {
-                    pen.setColor(track.at(i).color);
-                    pen.setWidthF(track.at(i).width - track.at(i).width/m_fadingTime);
-                    painter->setPen(pen);
-                    painter->drawLine(track.at(i).point,track.at(i+1).point);
-                }
-            }
-            else
-            {
-                m_scene->removeItem(this);
-                delete this;
-            }
-        }
-    }
+    };
+
+    //绘制阶段已完成的笔画保留在缓存中，每帧只追加新的线段
+    m_cache.paint(painter, m_boundingRect,
+                  [&](QPainter *cache) {drawSegments(cache, 0, paintCount);},
+                  [&](QPainter *cache) {drawSegments(cache, m_cachedCount, paintCount);});
+    m_cachedCount = paintCount;
 }
 
 QRectF OrchidItem::boundingRect() const
@@ -382,6 +968,18 @@ QRectF OrchidItem::boundingRect() const
 
 //-------------------------------------------------------------------------------------------
 
+PixmapItem::PixmapItem(const QPixmap &pixmap, QGraphicsItem *parent)
+    : QGraphicsObject(parent)
+    , pix(pixmap)
+{
+    ShowStats::global()->addBytes(ShowStats::ItemPixmaps, qint64(pix.width()) * pix.height() * 4);
+}
+
+PixmapItem::~PixmapItem()
+{
+    ShowStats::global()->addBytes(ShowStats::ItemPixmaps, -qint64(pix.width()) * pix.height() * 4);
+}
+
 QRectF PixmapItem::boundingRect() const
 {
     return QRect(-pix.width()/2,-pix.height()/2,pix.width(),pix.height());
@@ -389,9 +987,123 @@ QRectF PixmapItem::boundingRect() const
 
 void PixmapItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
 {
+    ShowStats::global()->paintCall();
     painter->drawPixmap(boundingRect(), pix, pix.rect());
 }
 
+void BackgroundItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    Q_UNUSED(option)
+    Q_UNUSED(widget)
+    ShowStats::global()->paintCall();
+    m_cache.paint(painter, boundingRect(), [this](QPainter *cache) {
+        cache->drawPixmap(boundingRect(), pixmap(), pixmap().rect());
+    });
+}
+
+//----------------------------------------------------------------------------------------
+
+PetalLayer::PetalLayer(const QPixmap &sheet, const QSize &cell, const QRectF &rect, QGraphicsItem *parent)
+    : QGraphicsItem(parent)
+    , m_sheet(sheet)
+    , m_cell(cell)
+    , m_columns((sheet.width() + cell.width() - 1) / cell.width())
+    , m_rows((sheet.height() + cell.height() - 1) / cell.height())
+    , m_rect(rect)
+{
+    ShowStats::global()->addBytes(ShowStats::ItemPixmaps, qint64(m_sheet.width()) * m_sheet.height() * 4);
+}
+
+PetalLayer::~PetalLayer()
+{
+    ShowStats::global()->addBytes(ShowStats::ItemPixmaps, -qint64(m_sheet.width()) * m_sheet.height() * 4);
+}
+
+int PetalLayer::step(int msecs)
+{
+    const int count = m_petals.count();
+    m_petals.erase(std::remove_if(m_petals.begin(), m_petals.end(), [msecs](Petal &petal) {
+        petal.elapsed += msecs;
+        return petal.elapsed >= petal.duration;
+    }), m_petals.end());
+    update();
+    return count - m_petals.count();
+}
+
+QRectF PetalLayer::boundingRect() const
+{
+    //起点在区域上方50，终点在区域下方50，再外扩一个贴图(旋转)
+    const qreal margin = std::max(m_cell.width(), m_cell.height());
+    return m_rect.adjusted(-margin, -50 - margin, margin, 50 + margin);
+}
+
+//位置按InQuad缓动(进度平方)，旋转与透明度线性变化
+void PetalLayer::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+{
+    ShowStats::global()->paintCall();
+    if(m_petals.isEmpty())
+    {
+        return;
+    }
+    const qreal startY = m_rect.top() - 50;
+    const qreal endY = m_rect.bottom() + 50;
+    const QRectF sheetRect = m_sheet.rect();
+    m_fragments.resize(m_petals.count());
+    for (int i = 0; i < m_petals.count(); ++i) {
+        const Petal &petal = m_petals.at(i);
+        const qreal t = qreal(petal.elapsed) / petal.duration;
+        const qreal eased = t * t;
+        const QPointF position(petal.startX + (petal.endX - petal.startX) * eased, startY + (endY - startY) * eased);
+        const QRectF source = QRectF(QPointF((petal.index % m_columns) * m_cell.width(), (petal.index / m_columns) * m_cell.height()),
+                                     m_cell).intersected(sheetRect);
+        m_fragments[i] = QPainter::PixmapFragment::create(position, source, 1, 1, petal.endRotation * t, 1 - t);
+    }
+    painter->drawPixmapFragments(m_fragments.constData(), m_fragments.count(), m_sheet);
+}
+
+//----------------------------------------------------------------------------------------
+
+LayerCache::~LayerCache()
+{
+    ShowStats::global()->addBytes(ShowStats::LayerImages, -m_image.sizeInBytes());
+}
+
+void LayerCache::paint(QPainter *painter, const QRectF &rect, const DrawFunction &draw, const DrawFunction &append)
+{
+    const qreal scale = qMax<qreal>(0.01, painter->deviceTransform().m11());
+    const QSize size = (rect.size() * scale).toSize().expandedTo(QSize(1,1));
+    const bool redraw = !m_valid || m_rect != rect || m_scale != scale;
+    if(redraw || append)
+    {
+        if(m_image.size() != size)
+        {
+            ShowStats::global()->addBytes(ShowStats::LayerImages, -m_image.sizeInBytes());
+            m_image = QImage(size, QImage::Format_ARGB32_Premultiplied);
+            ShowStats::global()->addBytes(ShowStats::LayerImages, m_image.sizeInBytes());
+        }
+        if(redraw)
+        {
+            m_image.fill(Qt::transparent);
+        }
+        QPainter cache(&m_image);
+        cache.setRenderHints(painter->renderHints());
+        cache.scale(scale, scale);
+        cache.translate(-rect.topLeft());
+        if(redraw)
+        {
+            draw(&cache);
+        }
+        else
+        {
+            append(&cache);
+        }
+        m_rect = rect;
+        m_scale = scale;
+        m_valid = true;
+    }
+    painter->drawImage(rect, m_image);
+}
+
 //----------------------------------------------------------------------------------------
 
 
@@ -3,9 +3,19 @@
 
 #include <QGraphicsObject>
 #include <QVector2D>
+#include <QImage>
+#include <QPainter>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <functional>
+#include <atomic>
+#include "lifetimelut.h"
+#include "triplebuffer.h"
 
 #define STEP_TIME 0.1
 #define Gravity 6.0
+#define PARTICLE_TILE 128               //粒子层分块边长(像素)
+#define PARALLEL_RASTER_MIN 256         //粒子数少于此值时不分发到工作线程
 
 namespace GraphicsItem {
 
@@ -27,41 +37,158 @@ typedef struct
 
 }ParticleParams;
 
+QDataStream &operator<<(QDataStream &out, const ParticleParams &params);
+QDataStream &operator>>(QDataStream &in, ParticleParams &params);
+
+#ifdef PARTICLE_DOUBLE_PRECISION
+typedef double ParticleReal;
+#else
+typedef float ParticleReal;             //默认单精度：场景坐标在几千像素以内，float足够
+#endif
+
+//粒子运行状态：每个模拟步读写的热数据，ParticleParams只作为发射描述与快照格式
+//颜色为预乘ARGB32，年龄、寿命、延迟为16位(按20ms一步约可表示21分钟)
+//只压缩了粒子自身的状态，每个粒子仍是一个QGraphicsObject，图元本身的开销不变
+template <typename Real>
+struct BasicParticleState
+{
+    Real x, y;              //振动中心
+    Real vx, vy;            //矢量速度
+    Real dx, dy;            //振动方向(单位向量)
+    Real mx, my;            //上一模拟步到本步的位移(用于插值)
+    Real size;
+    QRgb startColor;
+    QRgb endColor;
+    quint16 age;
+    quint16 lifeTime;
+    quint16 delay;
+
+    static BasicParticleState fromParams(const ParticleParams &params)
+    {
+        const QVector2D direction = params.direction.normalized();
+        BasicParticleState state;
+        state.x = Real(params.position.x());
+        state.y = Real(params.position.y());
+        state.vx = Real(params.velocity.x());
+        state.vy = Real(params.velocity.y());
+        state.dx = Real(direction.x());
+        state.dy = Real(direction.y());
+        state.mx = 0;
+        state.my = 0;
+        state.size = Real(params.size);
+        state.startColor = qPremultiply(params.startColor.rgba());
+        state.endColor = qPremultiply(params.endColor.rgba());
+        state.age = 0;
+        state.lifeTime = quint16(qBound(0, params.lifeTime, 0xffff));
+        state.delay = 0;
+        return state;
+    }
+
+    ParticleParams toParams() const
+    {
+        ParticleParams params;
+        params.position = QPointF(x, y);
+        params.velocity = QVector2D(vx, vy);
+        params.speed = params.velocity.length();
+        params.direction = QVector2D(dx, dy);
+        params.startColor = QColor::fromRgba(qUnpremultiply(startColor));
+        params.endColor = QColor::fromRgba(qUnpremultiply(endColor));
+        params.size = size;
+        params.lifeTime = lifeTime;
+        return params;
+    }
+};
+
+typedef BasicParticleState<ParticleReal> ParticleState;
+
+//粒子绘制记录：粒子层每帧收集，工作线程只读这些普通数据，不访问图元
+struct ParticleRecord
+{
+    QRectF rect;            //场景坐标下的绘制范围
+    QPointF motion;         //上一模拟步到本步的位移(用于插值)
+    QRgb color;             //预乘ARGB32(直接交给光栅化，不经过QColor)
+    bool sprite;            //是否叠加光斑贴图
+    float opacity;          //所属编剧的整体透明度(同时作用于光斑)
+};
+
 //-------------------------------------------------------------------------------------------
 
+class Screenwriter;
+class Emitter;
+
+//演员：由编剧驱动的场景元素，记录所属编剧，调度器每帧遍历一次场景并按此分派
+class Actor
+{
+public:
+    virtual ~Actor(){}
+    Screenwriter *owner() const {return m_owner;}
+    void setOwner(Screenwriter *owner){m_owner = owner;}
+
+private:
+    Screenwriter *m_owner = nullptr;
+};
+
 //粒子基类
-class Particle : public QGraphicsObject
+class Particle : public QGraphicsObject, public Actor
 {
     Q_OBJECT
 public:
+    enum { Type = UserType + 1 };
     explicit Particle(const ParticleParams& params, QGraphicsItem* parent = nullptr);
+    static Particle *create(int type, const ParticleParams &params);   //按图元类型创建粒子(用于快照恢复)
+
+    //光斑贴图按整数尺寸缩放后全局共享，只有QPainter回退绘制时才按需生成
+    static QImage sprite(int size);
+
+    int type() const override { return Type; }
 
     //更新粒子状态
     virtual void updatePaint();
 
-    int age() const { return m_age; }
-    bool isDead() const { return m_age >= m_params.lifeTime; }
-    const ParticleParams &params(){return m_params;}
+    //保存/恢复除ParticleParams以外的动态状态
+    virtual void saveState(QDataStream &out) const;
+    virtual void restoreState(QDataStream &in);
+
+    int age() const { return m_state.age; }
+    bool isDead() const { return m_state.age >= m_state.lifeTime; }
+    ParticleParams params() const {return m_state.toParams();}        //由运行状态还原(用于快照)
+    const ParticleState &state() const {return m_state;}
+
+    //影响器直接读写速度与振动中心，不经过ParticleParams
+    QVector2D velocity() const {return QVector2D(m_state.vx, m_state.vy);}
+    void setVelocity(const QVector2D &velocity){m_state.vx = velocity.x(); m_state.vy = velocity.y();}
+    void accelerate(const QVector2D &delta){m_state.vx += delta.x(); m_state.vy += delta.y();}
+    void shiftCenter(const QVector2D &offset){m_state.x += offset.x(); m_state.y += offset.y();}
 
-    void setParams(const ParticleParams &params){m_params = params;}
     void setVibration(qreal orthometricAmplitude,qreal parallelAmplitude,qreal frequency,bool randomPhase = true,qreal phase = 0);
-    void setDelay(int delay){m_delay = delay;}
+    void setDelay(int delay){m_state.delay = quint16(qBound(0, delay, 0xffff));}
+    void setLifetimeLut(const QSharedPointer<const LifetimeLut> &lut);     //设置生命周期查找表(颜色、透明度、尺寸)
+    const QSharedPointer<const LifetimeLut> &lifetimeLut() const {return m_lut;}
+    void setEmitter(Emitter *emitter){m_emitter = emitter;}                 //发射本粒子的发射器(用于触发子发射器)
+    Emitter *emitter() const {return m_emitter;}
+    virtual bool record(ParticleRecord *record) const;                     //生成绘制记录，无需绘制时返回false
 protected:
     QRectF boundingRect() const override;
     void paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*) override;
 
+    QRgb premultipliedColor() const;        //当前颜色(预乘ARGB32)
     QColor interpolateColor() const;
+    QRectF currentRect() const;             //当前生命进度下的绘制范围
+    int lutIndex() const {return std::min(int(m_state.age * m_lutScale), LifetimeLut::Resolution - 1);}
+    QColor startColor() const {return QColor::fromRgba(qUnpremultiply(m_state.startColor));}
+    QColor endColor() const {return QColor::fromRgba(qUnpremultiply(m_state.endColor));}
+    QVector2D direction() const {return QVector2D(m_state.dx, m_state.dy);}
 
-    ParticleParams m_params;
-    QPixmap m_pixmap;
-    int m_age;
-    int m_delay;
+    ParticleState m_state;
+    QSharedPointer<const LifetimeLut> m_lut;
+    float m_lutScale;                       //查找表下标系数 k = (Resolution - 1) / lifeTime
+    Emitter *m_emitter = nullptr;
 
 public:
-    qreal m_orthometricAmplitude;   //正交振幅
-    qreal m_parallelAmplitude;      //平行振幅
-    qreal m_frequency;              //频率
-    qreal m_phase;                  //初相位
+    ParticleReal m_orthometricAmplitude;    //正交振幅
+    ParticleReal m_parallelAmplitude;       //平行振幅
+    ParticleReal m_frequency;               //频率
+    ParticleReal m_phase;                   //初相位
 };
 
 //----------------------------------------------------------------------------------------------
@@ -70,11 +197,17 @@ public:
 class LampParticle : public Particle
 {
 public:
+    enum { Type = UserType + 2 };
     LampParticle(const ParticleParams& params, QGraphicsItem* parent = nullptr);
+    int type() const override { return Type; }
     void updatePaint() override;
+    void saveState(QDataStream &out) const override;
+    void restoreState(QDataStream &in) override;
     void setFlickerFrequency(int frequency){m_flickerFrequency = frequency;}
+    bool record(ParticleRecord *record) const override;
 
 protected:
+    QColor flickerColor() const;
     void paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*) override;
 
 private:
@@ -85,20 +218,28 @@ private:
 };
 
 
+class TrailLayer;
+
 class FlameParticle : public LampParticle
 {
 public:
+    enum { Type = UserType + 3 };
     FlameParticle(const ParticleParams& params, QGraphicsItem* parent = nullptr)
         : LampParticle(params,parent)
         , m_splash(false)
         , m_explode(false){}
+    int type() const override { return Type; }
     void updatePaint() override;
+    void saveState(QDataStream &out) const override;
+    void restoreState(QDataStream &in) override;
     void setExplodeParams(bool splash,bool explode){m_splash = splash;m_explode = explode;}
-    void setScene(QGraphicsScene *scene){m_scene = scene;}
+    void setTrailLayer(TrailLayer *trail){m_trail = trail;}     //设置拖尾层后溅射改为在拖尾层上盖印，不再生成粒子
 protected:
+    //溅射与爆炸生成的粒子放入所属编剧的生成队列，本帧演出结束后统一加入场景
     virtual void splashing();
     virtual void exploding();
-    QGraphicsScene *m_scene;
+    void spawn(Particle *particle);
+    TrailLayer *m_trail = nullptr;
 private:
 
     bool m_splash;
@@ -108,16 +249,127 @@ private:
 class FireworkParticle : public FlameParticle
 {
 public:
+    enum { Type = UserType + 4 };
     using FlameParticle::FlameParticle;
+    int type() const override { return Type; }
     void exploding() override;
     QVector2D calculateHeartPosition(qreal angle) const;
 };
 
+//生成队列：演出过程中(遍历场景快照时)新生成的粒子先放入队列，本帧所有编剧演出结束后一次性加入场景，
+//避免遍历中修改场景；队列容量跨帧保留
+class SpawnQueue
+{
+public:
+    ~SpawnQueue();
+    void push(Particle *particle){m_particles.append(particle);}
+    bool isEmpty() const {return m_particles.isEmpty();}
+    int count() const {return m_particles.count();}
+    void commit(QGraphicsScene *scene);
+
+private:
+    QVector<Particle*> m_particles;
+};
+
+//拖尾层：常驻的离屏图像，每帧按固定系数整体淡出，运动中的火焰在其上盖印，代价与粒子数无关
+class TrailLayer : public QGraphicsObject
+{
+public:
+    TrailLayer(const QRectF &rect, qreal fade = 0.88, QGraphicsItem* parent = nullptr);
+    ~TrailLayer();
+    void stamp(const QPointF &point, qreal size, const QColor &color);     //记录一次盖印，在advance()中统一绘制
+    void advance();                                                         //每帧调用：淡出并绘制本帧的盖印
+
+protected:
+    QRectF boundingRect() const override;
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*) override;
+
+private:
+    struct Stamp
+    {
+        QPointF point;
+        qreal size;
+        QColor color;
+    };
+
+    QRectF m_rect;
+    QImage m_image;
+    int m_fadeAlpha;            //每帧保留的比例(以1/256为单位，0~255)
+    QVector<Stamp> m_stamps;
+};
+
+//粒子层：代替逐个粒子绘制，粒子系统每帧把存活粒子的绘制记录交给粒子层(粒子本身不再绘制)，
+//绘制时按设备分辨率把离屏图像分成若干块，粒子按块分箱，每块由工作线程各自的QPainter并行光栅化，
+//各块直接写入同一张图像的不同区域，最后整体绘制到场景
+//流水线模式下每个显示帧末把记录(隐式共享，不复制)提交给光栅化线程写入三缓冲的后台图像，
+//GUI线程随即开始下一帧的模拟与绘制，绘制时取最近完成的图像，光栅化与模拟重叠，代价是粒子晚一帧显示
+class ParticleLayer : public QGraphicsObject
+{
+public:
+    ParticleLayer(const QRectF &rect, QGraphicsItem* parent = nullptr);
+    ~ParticleLayer();
+    void clear();                                   //每帧演出前清空记录
+    void append(Particle *particle, qreal opacity = 1.0);  //收集粒子的绘制记录(opacity为所属编剧的整体透明度)并隐藏粒子自身的绘制
+    void commit();                                  //本帧收集完毕
+    void setInterpolation(qreal alpha);             //显示帧位于两模拟步之间的进度[0,1)，绘制位置据此插值
+
+    void setPipelined(bool pipelined);
+    bool isPipelined() const {return m_pipelined;}
+    void submit();                                  //流水线模式：提交本帧光栅化(显示帧末调用，上一帧仍在光栅化时跳过)，否则无操作
+    void flush();                                   //流水线模式：等待光栅化完成、补交被跳过的记录并重绘(停止出帧前调用)
+
+protected:
+    QRectF boundingRect() const override;
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*) override;
+
+private:
+    static void resizeImage(QImage *image, const QSize &size);
+    static QRectF recordRect(const ParticleRecord &record, qreal alpha);
+    void rasterize(QImage *image, const QVector<ParticleRecord> &records, qreal alpha, qreal scale);
+    static void rasterizeTile(uchar *bits, qsizetype bytesPerLine, const QRect &tile, const QVector<int> &indices,
+                              const QVector<ParticleRecord> &records, qreal alpha, qreal scale);
+
+    QRectF m_rect;
+    QImage m_image;
+
+    QVector<ParticleRecord> m_records;
+    qreal m_alpha = 1.0;
+    bool m_dirty = false;
+    QThreadPool m_pool;
+
+    bool m_pipelined = false;
+    qreal m_scale = 1.0;                            //最近一次绘制的设备缩放(流水线模式按此光栅化)
+    QThreadPool m_pipeline;                         //光栅化线程(单线程，同一时刻只有一个后台缓冲的写者)
+    std::atomic<bool> m_rasterizing{false};         //流水线中有尚未完成的光栅化
+    TripleBuffer<QImage> m_buffers;
+};
+
+//图层缓存：按设备分辨率保存预乘图像，只有内容失效或分辨率改变时才重新光栅化，
+//其余帧(包括只改变透明度的淡入淡出)只需一次混合
+class LayerCache
+{
+public:
+    using DrawFunction = std::function<void(QPainter*)>;
+    ~LayerCache();
+
+    void invalidate(){m_valid = false;}
+    //缓存有效时只执行append(可为空)在已有内容上追加绘制，否则清空后执行draw重绘，最后把缓存混合到painter
+    void paint(QPainter *painter, const QRectF &rect, const DrawFunction &draw, const DrawFunction &append = nullptr);
+
+private:
+    QImage m_image;
+    QRectF m_rect;
+    qreal m_scale = 0;
+    bool m_valid = false;
+};
+
 //重写PixmapItem类,坑爹玩意QGraphicsPixmapItem是继承的QGraphicsItem而非QGraphicsObject，不能应用QPropertyAnimation
 class PixmapItem : public QGraphicsObject
 {
 public:
-    PixmapItem(const QPixmap& pixmap, QGraphicsItem* parent = nullptr) : QGraphicsObject(parent), pix(pixmap){}
+    PixmapItem(const QPixmap& pixmap, QGraphicsItem* parent = nullptr);
+    ~PixmapItem();
+    const QPixmap &pixmap() const {return pix;}
 
 protected:
     QRectF boundingRect() const override;
@@ -129,26 +381,75 @@ private:
 };
 
 
+//背景：整幅背景图只光栅化一次，淡入淡出只改变混合时的透明度
 class BackgroundItem : public PixmapItem
 {
 public:
     using PixmapItem::PixmapItem;
+
+protected:
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) override;
+
+private:
+    LayerCache m_cache;
 };
 
 
-class FallingItem : public PixmapItem
+//花瓣层：花瓣是普通结构体，位置、旋转与透明度由飘落进度按解析式直接求出，
+//每帧一次批量计算，整层从切片贴图集中用一次drawPixmapFragments绘制
+//(QGraphicsItem没有线程归属，可以在时间线线程创建)
+class PetalLayer : public QGraphicsItem, public Actor
 {
 public:
-    using PixmapItem::PixmapItem;
+    struct Petal
+    {
+        int index;          //贴图下标
+        qreal startX;       //起始x坐标
+        qreal endX;         //结束x坐标
+        int endRotation;    //结束旋转角度
+        int duration;       //飘落时长(毫秒)
+        int elapsed;        //已飘落时间(毫秒)
+    };
+
+    enum { Type = UserType + 6 };
+    PetalLayer(const QPixmap &sheet, const QSize &cell, const QRectF &rect, QGraphicsItem* parent = nullptr);
+    ~PetalLayer();
+    int type() const override { return Type; }
+
+    int spriteCount() const {return m_columns * m_rows;}
+    void add(const Petal &petal){m_petals.append(petal);}
+    int step(int msecs);                                    //推进所有花瓣，返回本次落地移除的数量
+    const QVector<Petal> &petals() const {return m_petals;}
+
+protected:
+    QRectF boundingRect() const override;
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*) override;
+
+private:
+    QPixmap m_sheet;
+    QSize m_cell;
+    int m_columns;
+    int m_rows;
+    QRectF m_rect;                                          //飘落区域(场景坐标)
+    QVector<Petal> m_petals;
+    QVector<QPainter::PixmapFragment> m_fragments;
 };
 
-class OrchidItem : public QGraphicsObject
+class OrchidItem : public QGraphicsObject, public Actor
 {
 public:
+    enum { Type = UserType + 5 };
     OrchidItem(const QVector2D &point,const QVector2D &v, QGraphicsScene *scene,QGraphicsItem *parent = nullptr);
+    ~OrchidItem();
+    int type() const override { return Type; }
     void setOrchid(int length,const QColor &color1,const QColor &color2,float width1,float width2); //设置轨迹参数
     void setPainting(int waitTime,int paintingTime,int fadingTime);                                 //设置绘制参数
     void start();
+    void updatePaint();                                                                             //每帧推进绘制进度
+    bool isFinished() const {return m_finished;}
+
+    void saveState(QDataStream &out) const;
+    static OrchidItem *restore(QDataStream &in, QGraphicsScene *scene);                             //从快照重建并加入场景
 
     void paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*) override;
     QRectF boundingRect() const override;
@@ -164,6 +465,7 @@ private:
     int m_waitTime;
     int m_paintingTime;
     int m_fadingTime;
+    bool m_finished = false;
 
     struct Primitive
     {
@@ -174,6 +476,8 @@ private:
 
     QVector<Primitive> track;
     QRectF m_boundingRect;
+    LayerCache m_cache;                 //已完成的笔画
+    int m_cachedCount = 0;              //缓存中已绘制的线段数
 };
 
 
@@ -0,0 +1,66 @@
+#include "lifetimelut.h"
+
+LifetimeLut::LifetimeLut(const QGradientStops &colorStops, const Curve &alphaCurve, const Curve &sizeCurve)
+    : m_hasColor(!colorStops.isEmpty())
+{
+    for (int i = 0; i < Resolution; ++i) {
+        const qreal t = qreal(i) / (Resolution - 1);
+        m_alphas[i] = float(evaluate(alphaCurve, t));
+        m_sizes[i] = float(evaluate(sizeCurve, t));
+        m_maxSize = std::max(m_maxSize, m_sizes[i]);
+
+        if(!m_hasColor)
+        {
+            m_colors[i] = 0;
+            continue;
+        }
+
+        //在相邻色标间插值
+        QColor color = colorStops.last().second;
+        if(t <= colorStops.first().first)
+        {
+            color = colorStops.first().second;
+        }
+        else
+        {
+            for (int s = 1; s < colorStops.count(); ++s) {
+                if(t <= colorStops.at(s).first)
+                {
+                    const QGradientStop &a = colorStops.at(s - 1);
+                    const QGradientStop &b = colorStops.at(s);
+                    const qreal ratio = b.first > a.first ? (t - a.first) / (b.first - a.first) : 1.0;
+                    color = QColor::fromRgbF(
+                        a.second.redF()   + (b.second.redF()   - a.second.redF())   * ratio,
+                        a.second.greenF() + (b.second.greenF() - a.second.greenF()) * ratio,
+                        a.second.blueF()  + (b.second.blueF()  - a.second.blueF())  * ratio,
+                        a.second.alphaF() + (b.second.alphaF() - a.second.alphaF()) * ratio);
+                    break;
+                }
+            }
+        }
+        color.setAlphaF(qBound(0.0f, float(color.alphaF()) * m_alphas[i], 1.0f));
+        m_colors[i] = qPremultiply(color.rgba());
+    }
+}
+
+qreal LifetimeLut::evaluate(const Curve &curve, qreal t, qreal defaultValue)
+{
+    if(curve.isEmpty())
+    {
+        return defaultValue;
+    }
+    if(t <= curve.first().x())
+    {
+        return curve.first().y();
+    }
+    for (int i = 1; i < curve.count(); ++i) {
+        if(t <= curve.at(i).x())
+        {
+            const QPointF &a = curve.at(i - 1);
+            const QPointF &b = curve.at(i);
+            const qreal ratio = b.x() > a.x() ? (t - a.x()) / (b.x() - a.x()) : 1.0;
+            return a.y() + (b.y() - a.y()) * ratio;
+        }
+    }
+    return curve.last().y();
+}
@@ -0,0 +1,36 @@
+#ifndef LIFETIMELUT_H
+#define LIFETIMELUT_H
+
+#include <QColor>
+#include <QBrush>
+#include <QPointF>
+#include <QVector>
+
+//粒子生命周期查找表
+//发射器启动时将颜色、透明度、尺寸随生命周期变化的曲线采样成小表，绘制时按 age * k 直接取值
+class LifetimeLut
+{
+public:
+    using Curve = QVector<QPointF>;         //分段线性曲线，x为生命进度[0,1]，y为取值
+    static constexpr int Resolution = 64;
+
+    //colorStops为空时不烘焙颜色，由粒子自身的起止颜色插值(仍应用透明度曲线)
+    LifetimeLut(const QGradientStops &colorStops, const Curve &alphaCurve, const Curve &sizeCurve);
+
+    static qreal evaluate(const Curve &curve, qreal t, qreal defaultValue = 1.0);
+
+    bool hasColor() const {return m_hasColor;}
+    QRgb premultiplied(int index) const {return m_colors[index];}      //预乘ARGB32
+    float alpha(int index) const {return m_alphas[index];}
+    float size(int index) const {return m_sizes[index];}
+    float maxSize() const {return m_maxSize;}
+
+private:
+    bool m_hasColor;
+    QRgb m_colors[Resolution];
+    float m_alphas[Resolution];
+    float m_sizes[Resolution];
+    float m_maxSize = 1.0f;
+};
+
+#endif // LIFETIMELUT_H
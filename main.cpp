@@ -1,11 +1,57 @@
 #include "pipedream.h"
+#include "showstats.h"
+#include "synclatency.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    //演出参数：--render-scale 50 以一半分辨率渲染后放大，--fullscreen 全屏输出(投影)，
+    //--stats stats.jsonl 定期追加演出统计，--sync-latency sync.jsonl 每场演出结束时追加音画同步延迟，
+    //--pipelined 粒子光栅化与下一帧的模拟重叠，--smooth-transitions 场景交叉淡入淡出、背景擦除
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption renderScaleOption("render-scale", "内部渲染比例(百分比，25~100)", "percent", "100");
+    QCommandLineOption fullScreenOption("fullscreen", "全屏演出");
+    QCommandLineOption statsOption("stats", "定期将演出统计追加到文件(每行一个JSON)", "file");
+    QCommandLineOption statsIntervalOption("stats-interval", "统计转储间隔(毫秒)", "ms", "1000");
+    QCommandLineOption syncLatencyOption("sync-latency", "每场演出结束时将时间线事件的音画同步延迟追加到文件(每行一个JSON)", "file");
+    parser.addOption(renderScaleOption);
+    parser.addOption(fullScreenOption);
+    parser.addOption(statsOption);
+    parser.addOption(statsIntervalOption);
+    QCommandLineOption pipelinedOption("pipelined", "流水线模式：粒子在后台线程光栅化，与下一帧的模拟重叠");
+    parser.addOption(syncLatencyOption);
+    parser.addOption(pipelinedOption);
+    QCommandLineOption smoothTransitionsOption("smooth-transitions", "场景之间交叉淡入淡出，白景与夜景之间改为擦除");
+    parser.addOption(smoothTransitionsOption);
+    parser.process(a);
+
+    bool ok = false;
+    const double percent = parser.value(renderScaleOption).toDouble(&ok);
+    if(parser.isSet(statsOption))
+    {
+        ShowStats::global()->startDump(parser.value(statsOption), std::max(100, parser.value(statsIntervalOption).toInt()));
+    }
+    if(parser.isSet(syncLatencyOption))
+    {
+        SyncLatency::global()->setDumpFile(parser.value(syncLatencyOption));
+    }
+
     PipeDream w;
-    w.show();
+    w.setRenderScale(ok ? percent / 100.0 : 1.0);
+    w.setPipelined(parser.isSet(pipelinedOption));
+    w.setSmoothTransitions(parser.isSet(smoothTransitionsOption));
+    if(parser.isSet(fullScreenOption))
+    {
+        w.showFullScreen();
+    }
+    else
+    {
+        w.show();
+    }
     return a.exec();
 }
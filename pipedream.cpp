@@ -1,21 +1,27 @@
 #include "pipedream.h"
 #include "graphicsitems.h"
 #include <QGraphicsScene>
+#include <QKeyEvent>
+#include <QPainter>
+#include "framedriver.h"
+#include "showstats.h"
 
 PipeDream::PipeDream(QWidget *parent)
     : QGraphicsView(parent)
 {
     //绘图窗口设置
     setWindowTitle("PipeDream");
-    setFixedSize(1440,900);
+    resize(SCENE_WIDTH,SCENE_HEIGHT);
+    setFrameShape(QFrame::NoFrame);
     setRenderHint(QPainter::Antialiasing);
     setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 
     //绘图场景设置
     m_scene = new QGraphicsScene(this);                                      //场景演出元素管理器
-    m_scene->setSceneRect(0,0,this->width(),this->height());
+    m_scene->setSceneRect(0,0,SCENE_WIDTH,SCENE_HEIGHT);                     //固定的设计坐标，显示时按窗口缩放
     m_sequencer = new Sequencer(m_scene,this);                              //场景调度器
+    m_sequencer->frameDriver()->setWidget(this);                            //按本窗口所在屏幕的刷新率出帧
     setScene(m_scene);
 
     //音乐播放器设置
@@ -27,17 +33,14 @@ PipeDream::PipeDream(QWidget *parent)
     connect(m_player,&QMediaPlayer::positionChanged,this,&PipeDream::onMusicPositionChanged,Qt::QueuedConnection);
     connect(m_player,&QMediaPlayer::mediaStatusChanged,this,&PipeDream::onMediaStatusChanged,Qt::QueuedConnection);
     connect(m_sequencer,&Sequencer::started,m_player,&QMediaPlayer::play,Qt::QueuedConnection);
+    connect(m_sequencer,&Sequencer::seeked,this,&PipeDream::onSeeked);
 
     m_sequencer->start();
 }
 
 PipeDream::~PipeDream()
 {
-    if(m_sequencer->isRunning())
-    {
-        m_sequencer->requestInterruption();
-        m_sequencer->wait();
-    }
+    m_sequencer->stopTimeline();
     delete m_sequencer;
     delete m_scene;
 }
@@ -45,6 +48,7 @@ PipeDream::~PipeDream()
 
 void PipeDream::onMusicPositionChanged(qint64 position)
 {
+    m_sequencer->setCurrentPosition(position);
     int sec = position/1000;
     if(sec <= m_count)
     {
@@ -62,6 +66,7 @@ void PipeDream::onMediaStatusChanged(QMediaPlayer::MediaStatus status)
         qDebug() << "播放结束！";
         // 在这里处理播放结束后的逻辑
         m_count = 0;
+        m_sequencer->curtain();
         CustomButton *replay = new CustomButton(QPixmap(":/replay.png"));
         replay->setPos(50,50);
         connect(replay,&CustomButton::clicked,this,&PipeDream::onCustomButtonClicked);
@@ -84,3 +89,93 @@ void PipeDream::onCustomButtonClicked()
 
     QMetaObject::invokeMethod(m_sequencer, "start", Qt::QueuedConnection);
 }
+
+void PipeDream::onSeeked(qint64 position)
+{
+    //移除结束后的重播按钮并同步音乐位置
+    QList<QGraphicsItem*> items = m_scene->items();
+    for (QGraphicsItem *item : items) {
+        if (dynamic_cast<CustomButton*>(item)) {
+            m_scene->removeItem(item);
+            delete item;
+        }
+    }
+    m_count = position/1000;
+    m_player->setPosition(position);
+    if(m_player->playbackState() != QMediaPlayer::PlayingState)
+    {
+        m_player->play();
+    }
+}
+
+void PipeDream::setRenderScale(qreal scale)
+{
+    m_renderScale = qBound(MIN_RENDER_SCALE, scale, 1.0);
+    ShowStats::global()->addBytes(ShowStats::LayerImages, -m_renderBuffer.sizeInBytes());
+    m_renderBuffer = QImage();
+    //离屏渲染每帧重绘整个缓冲，局部更新没有意义
+    setViewportUpdateMode(m_renderScale < 1.0 ? QGraphicsView::FullViewportUpdate : QGraphicsView::MinimalViewportUpdate);
+    viewport()->update();
+}
+
+//设计坐标按比例适配窗口，多余部分留边
+void PipeDream::resizeEvent(QResizeEvent *event)
+{
+    QGraphicsView::resizeEvent(event);
+    fitInView(m_scene->sceneRect(), Qt::KeepAspectRatio);
+}
+
+void PipeDream::paintEvent(QPaintEvent *event)
+{
+    if(m_renderScale >= 1.0)
+    {
+        QGraphicsView::paintEvent(event);
+        return;
+    }
+
+    //按渲染比例绘制到离屏缓冲
+    const QRectF target = mapFromScene(sceneRect()).boundingRect();
+    const qreal scale = viewport()->devicePixelRatioF() * m_renderScale;
+    const QSize size = QSizeF(target.width() * scale, target.height() * scale).toSize().expandedTo(QSize(1,1));
+    if(m_renderBuffer.size() != size)
+    {
+        ShowStats::global()->addBytes(ShowStats::LayerImages, -m_renderBuffer.sizeInBytes());
+        m_renderBuffer = QImage(size, QImage::Format_ARGB32_Premultiplied);
+        ShowStats::global()->addBytes(ShowStats::LayerImages, m_renderBuffer.sizeInBytes());
+    }
+    m_renderBuffer.fill(Qt::transparent);
+    QPainter buffer(&m_renderBuffer);
+    buffer.setRenderHints(renderHints());
+    m_scene->render(&buffer, QRectF(QPointF(0,0), size), sceneRect(), Qt::IgnoreAspectRatio);
+    buffer.end();
+
+    //放大到窗口
+    QPainter painter(viewport());
+    painter.fillRect(viewport()->rect(), m_scene->backgroundBrush());
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.drawImage(target, m_renderBuffer);
+}
+
+//排练用跳转：←/→ 前后10秒，1~5 跳到各场景开始
+void PipeDream::keyPressEvent(QKeyEvent *event)
+{
+    static const qint64 cues[] = {5000, 60000, 90000, 115000, 186000};
+    switch (event->key()) {
+    case Qt::Key_Left:
+        m_sequencer->seek(m_player->position() - 10000);
+        break;
+    case Qt::Key_Right:
+        m_sequencer->seek(m_player->position() + 10000);
+        break;
+    case Qt::Key_1:
+    case Qt::Key_2:
+    case Qt::Key_3:
+    case Qt::Key_4:
+    case Qt::Key_5:
+        m_sequencer->seek(cues[event->key() - Qt::Key_1]);
+        break;
+    default:
+        QGraphicsView::keyPressEvent(event);
+        break;
+    }
+}
@@ -4,7 +4,12 @@
 #include <QGraphicsView>
 #include <QMediaPlayer>
 #include <QAudioOutput>
+#include <QImage>
 #include "sequencer.h"
+
+#define SCENE_WIDTH 1440            //场景设计坐标宽度，与输出分辨率无关
+#define SCENE_HEIGHT 900            //场景设计坐标高度
+#define MIN_RENDER_SCALE 0.25
 /**
  * @brief The PipeDream class
  *
@@ -38,10 +43,22 @@ public:
     PipeDream(QWidget *parent = nullptr);
     ~PipeDream();
 
+    //内部渲染比例：小于1时场景先渲染到按比例缩小的离屏缓冲，再平滑放大到窗口，以清晰度换填充率
+    void setRenderScale(qreal scale);
+    void setPipelined(bool pipelined){m_sequencer->setPipelined(pipelined);}
+    void setSmoothTransitions(bool smooth){m_sequencer->setSmoothTransitions(smooth);}
+    qreal renderScale() const {return m_renderScale;}
+
 public slots:
     void onMusicPositionChanged(qint64 position);
     void onMediaStatusChanged(QMediaPlayer::MediaStatus status);
     void onCustomButtonClicked();
+    void onSeeked(qint64 position);
+
+protected:
+    void keyPressEvent(QKeyEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
 
 signals:
     void played();
@@ -58,5 +75,9 @@ private:
     //计时
     int m_count = 0;
 
+    //渲染
+    qreal m_renderScale = 1.0;
+    QImage m_renderBuffer;
+
 };
 #endif // PIPEDREAM_H
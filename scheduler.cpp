@@ -0,0 +1,197 @@
+#include "scheduler.h"
+#include "screenwriter.h"
+#include "showstats.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+
+Scheduler::Scheduler(QGraphicsScene *scene)
+    : m_scene(scene)
+{
+}
+
+Scheduler::~Scheduler()
+{
+    clear();
+}
+
+void Scheduler::add(Screenwriter *screenwriter)
+{
+    QMutexLocker locker(&m_mutex);
+    screenwriter->setParticleLayer(m_layer);
+    m_screenwriters.append(screenwriter);
+    ShowStats::global()->registerSystem(screenwriter);
+}
+
+void Scheduler::stopOldest()
+{
+    QMutexLocker locker(&m_mutex);
+    for (Screenwriter *screenwriter : std::as_const(m_screenwriters)) {
+        if(!screenwriter->isStopping() && !screenwriter->isRehearsing())
+        {
+            screenwriter->shouldStop();
+            return;
+        }
+    }
+}
+
+void Scheduler::stopAll()
+{
+    QMutexLocker locker(&m_mutex);
+    for (Screenwriter *screenwriter : std::as_const(m_screenwriters)) {
+        screenwriter->shouldStop();
+    }
+}
+
+bool Scheduler::handOver(const Screenwriter *to, const std::function<void(Screenwriter*)> &func)
+{
+    QMutexLocker locker(&m_mutex);
+    for (int i = m_screenwriters.count() - 1; i >= 0; --i) {
+        Screenwriter *screenwriter = m_screenwriters.at(i);
+        if(screenwriter != to && !screenwriter->isRehearsing())
+        {
+            screenwriter->shouldStop();
+            func(screenwriter);
+            return true;
+        }
+    }
+    return false;
+}
+
+Screenwriter *Scheduler::reveal(int sceneId, qreal opacity)
+{
+    QMutexLocker locker(&m_mutex);
+    for (Screenwriter *screenwriter : std::as_const(m_screenwriters)) {
+        if(screenwriter->sceneId() == sceneId && screenwriter->isRehearsing())
+        {
+            screenwriter->setOpacity(opacity);
+            screenwriter->setRehearsing(false);
+            return screenwriter;
+        }
+    }
+    return nullptr;
+}
+
+void Scheduler::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    for (Screenwriter *screenwriter : std::as_const(m_screenwriters)) {
+        ShowStats::global()->unregisterSystem(screenwriter);
+        delete screenwriter;
+    }
+    m_screenwriters.clear();
+}
+
+QList<Screenwriter*> Scheduler::screenwriters() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_screenwriters;
+}
+
+bool Scheduler::isEmpty() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_screenwriters.isEmpty();
+}
+
+void Scheduler::setMediaPosition(qint64 position)
+{
+    QMutexLocker locker(&m_mutex);
+    for (Screenwriter *screenwriter : std::as_const(m_screenwriters)) {
+        screenwriter->setMediaPosition(position);
+    }
+}
+
+void Scheduler::skipTime(int msecs)
+{
+    QMutexLocker locker(&m_mutex);
+    for (Screenwriter *screenwriter : std::as_const(m_screenwriters)) {
+        screenwriter->skipTime(msecs);
+    }
+}
+
+void Scheduler::tick()
+{
+    QElapsedTimer timer;
+    timer.start();
+    QMutexLocker locker(&m_mutex);
+    ShowStats::global()->tickStarted();
+
+    //正在演出的编剧，按优先级从高到低
+    QList<Screenwriter*> active;
+    for (Screenwriter *screenwriter : std::as_const(m_screenwriters)) {
+        if(screenwriter->isShowing())
+        {
+            active.append(screenwriter);
+        }
+    }
+    std::stable_sort(active.begin(), active.end(), [](const Screenwriter *a, const Screenwriter *b) {
+        return a->priority() > b->priority();
+    });
+
+    //生成新元素：上一帧超出预算时只有最高优先级的编剧继续生成，其余只推进已有元素
+    if(!active.isEmpty())
+    {
+        const bool overBudget = m_lastTickCost > m_frameBudget;
+        const int top = active.first()->priority();
+        for (Screenwriter *screenwriter : std::as_const(active)) {
+            if(!overBudget || screenwriter->priority() >= top)
+            {
+                screenwriter->spawn();
+            }
+        }
+    }
+
+    //遍历一次场景，按所属编剧分派(同一编剧的元素通常相邻，缓存上一次的查找结果)
+    QVector<QList<QGraphicsItem*>> actors(active.count());
+    const Screenwriter *lastOwner = nullptr;
+    int lastIndex = -1;
+    const QList<QGraphicsItem*> items = m_scene->items();
+    for (QGraphicsItem *item : items) {
+        const Actor *actor = dynamic_cast<Actor*>(item);
+        if(!actor || !actor->owner())
+        {
+            continue;
+        }
+        if(actor->owner() != lastOwner)
+        {
+            lastOwner = actor->owner();
+            lastIndex = active.indexOf(actor->owner());
+        }
+        if(lastIndex >= 0)
+        {
+            actors[lastIndex].append(item);
+        }
+    }
+
+    if(m_layer)
+    {
+        m_layer->clear();
+    }
+    for (int i = 0; i < active.count(); ++i) {
+        active.at(i)->stats().live.store(actors.at(i).count(), std::memory_order_relaxed);
+        active.at(i)->actOut(actors.at(i));
+    }
+    if(m_layer)
+    {
+        m_layer->commit();
+    }
+
+    //演出中生成的粒子统一加入场景(下一帧开始参与演出)
+    for (Screenwriter *screenwriter : std::as_const(active)) {
+        screenwriter->spawnQueue().commit(m_scene);
+    }
+
+    //演出结束的编剧退出节目单
+    for (int i = m_screenwriters.count() - 1; i >= 0; --i) {
+        if(m_screenwriters.at(i)->isExecuted())
+        {
+            ShowStats::global()->unregisterSystem(m_screenwriters.at(i));
+            delete m_screenwriters.takeAt(i);
+            qDebug() << "下一个节目";
+        }
+    }
+
+    m_lastTickCost = timer.nsecsElapsed() / 1000;
+}
@@ -0,0 +1,50 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <QGraphicsScene>
+#include <QList>
+#include <QMutex>
+#include <functional>
+
+#define FRAME_BUDGET 12000          //每帧演出预算(微秒)
+
+class Screenwriter;
+class ParticleLayer;
+
+//调度器：同时推进任意多个正在演出的编剧
+//每帧先由各编剧生成新元素，再遍历一次场景并按元素所属编剧分派，各编剧只处理分派给自己的元素，
+//场景交叠时的代价是各自元素数之和，而不是编剧数乘以场景规模
+class Scheduler
+{
+public:
+    explicit Scheduler(QGraphicsScene *scene);
+    ~Scheduler();
+
+    void add(Screenwriter *screenwriter);               //加入节目单(可在时间线线程调用)
+    void stopOldest();                                  //最早出场且未收场的编剧结束演出(排练中的除外)
+    void stopAll();                                     //所有编剧结束演出(谢幕)
+    //交接：除to以外最后加入节目单的编剧(排练中的除外)结束演出，并在持锁期间对其调用func(期间不会退出节目单)，没有时返回false
+    bool handOver(const Screenwriter *to, const std::function<void(Screenwriter*)> &func);
+    Screenwriter *reveal(int sceneId, qreal opacity = 1.0);   //以opacity结束该场景编剧的排练并显示，没有排练中的编剧时返回nullptr
+    void clear();                                       //删除所有编剧
+    QList<Screenwriter*> screenwriters() const;
+    bool isEmpty() const;                               //没有任何编剧(包括排练中的)
+
+    void setMediaPosition(qint64 position);             //每帧演出前设置当前音乐位置(毫秒)
+    void skipTime(int msecs);                           //快进时推进依赖墙钟的动画
+    void tick();                                        //推进一帧演出
+
+    void setParticleLayer(ParticleLayer *layer){m_layer = layer;}      //粒子系统的粒子统一交给粒子层绘制
+    void setFrameBudget(qint64 usecs){m_frameBudget = usecs;}
+    qint64 lastTickCost() const {return m_lastTickCost;}
+
+private:
+    QGraphicsScene *m_scene;
+    ParticleLayer *m_layer = nullptr;
+    mutable QMutex m_mutex;                             //节目单由时间线线程追加，由场景线程推进
+    QList<Screenwriter*> m_screenwriters;
+    qint64 m_frameBudget = FRAME_BUDGET;
+    qint64 m_lastTickCost = 0;                          //上一帧演出耗时(微秒)
+};
+
+#endif // SCHEDULER_H
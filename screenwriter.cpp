@@ -4,94 +4,203 @@
 #include "graphicsitems.h"
 
 #include <QTimer>
-#include <QRandomGenerator>
-#include <QPropertyAnimation>
-#include <QParallelAnimationGroup>
+#include "simrandom.h"
+#include "sequencer.h"
+#include <functional>
+
+namespace {
+
+//保存owner拥有的粒子：类型、参数、查找表下标(lutIndex返回-1表示无)及动态状态
+void writeParticles(QDataStream &out, QGraphicsScene *scene, const Screenwriter *owner, const std::function<int(const Particle*)> &lutIndex)
+{
+    QList<Particle*> particles;
+    const QList<QGraphicsItem*> items = scene->items();
+    for (QGraphicsItem *item : items) {
+        auto p = dynamic_cast<Particle*>(item);
+        if (p && p->owner() == owner) {
+            particles.append(p);
+        }
+    }
+    out << qint32(particles.count());
+    for (const Particle *p : std::as_const(particles)) {
+        out << qint32(p->type()) << qint32(lutIndex(p)) << p->params();
+        p->saveState(out);
+    }
+}
+
+QList<Particle*> readParticles(QDataStream &in, QGraphicsScene *scene, Screenwriter *owner)
+{
+    qint32 count;
+    in >> count;
+    QList<Particle*> particles;
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        qint32 type, lut;
+        ParticleParams params;
+        in >> type >> lut >> params;
+        Particle *p = Particle::create(type, params);
+        p->restoreState(in);
+        p->setData(0, lut);         //查找表下标暂存，由调用者重新关联
+        p->setOwner(owner);
+        if(owner->particleLayer())
+        {
+            p->setFlag(QGraphicsItem::ItemHasNoContents);
+        }
+        scene->addItem(p);
+        particles.append(p);
+    }
+    return particles;
+}
+
+}
+
+void Screenwriter::saveState(QDataStream &out) const
+{
+    out << m_showing << m_shouldStop << m_exeunted << m_rehearsing;
+}
+
+void Screenwriter::restoreState(QDataStream &in)
+{
+    in >> m_showing >> m_shouldStop >> m_exeunted >> m_rehearsing;
+}
 
 EnframedScenery::~EnframedScenery()
 {
+    if(m_petals)
+    {
+        if(m_petals->scene())
+        {
+            m_petals->scene()->removeItem(m_petals);
+        }
+        delete m_petals;
+    }
+}
+
+void EnframedScenery::setPetalSheet(const QString &fileName, const QSize &cell)
+{
+    m_sheetFile = fileName;
+    m_cell = cell;
+    m_sheet = QImage();
 }
 
+//图片解码放在预热阶段，演出时只需转换为QPixmap
 void EnframedScenery::precondition()
 {
+    if(m_sheet.isNull() && !m_sheetFile.isEmpty())
+    {
+        m_sheet = QImage(m_sheetFile).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+}
 
+void EnframedScenery::createPetalLayer()
+{
+    precondition();
+    if(m_petals || m_sheet.isNull())
+    {
+        return;
+    }
+    m_petals = new PetalLayer(QPixmap::fromImage(m_sheet), m_cell, m_scene->sceneRect());
+    m_petals->setOwner(this);
 }
 
-void EnframedScenery::actOut()
+void EnframedScenery::spawn()
 {
+    createPetalLayer();
+    if(m_petals && !m_petals->scene())
+    {
+        m_scene->addItem(m_petals);
+    }
+    if(m_petals)
+    {
+        m_petals->setVisible(!m_rehearsing);
+        m_petals->setOpacity(m_opacity);
+    }
     if(!m_shouldStop)
     {
-        static int count = 0;
-        count++;
-        if(count > 2)
+        m_count++;
+        if(m_count > 2)
         {
             createFalling();
-            count = 0;
+            m_count = 0;
         }
     }
-    else
+}
+
+//所有花瓣按模拟步长批量推进，快进时同样适用
+void EnframedScenery::actOut(const QList<QGraphicsItem*> &actors)
+{
+    Q_UNUSED(actors)
+    if(!m_petals)
     {
-        bool containsFallingItem = false;
-        QList<QGraphicsItem*> items = m_scene->items();
-        for (QGraphicsItem *item : items) {
-            if (dynamic_cast<FallingItem*>(item)) {
-                containsFallingItem = true;
-                break;
-            }
-        }
-        if(!containsFallingItem)
-        {
-            m_exeunted = true;
-            m_showing = false;
-        }
+        return;
+    }
+    ShowStats::died(this, m_petals->step(TICK_INTERVAL));
+    m_stats.live.store(m_petals->petals().count(), std::memory_order_relaxed);
+    if(m_shouldStop && m_petals->petals().isEmpty())
+    {
+        m_exeunted = true;
+        m_showing = false;
     }
 }
 
 void EnframedScenery::createFalling()
 {
-    int index = QRandomGenerator::global()->bounded(dynamicPixmaps.count());
-    FallingItem *item = new FallingItem(dynamicPixmaps.at(index));
-    int startX = QRandomGenerator::global()->bounded(m_scene->width());
-    item->setPos(startX,-50);
-    m_scene->addItem(item);
-    // 创建动画组合
-    QPropertyAnimation* posAnim = new QPropertyAnimation(item, "pos");
-    QPropertyAnimation* rotateAnim = new QPropertyAnimation(item, "rotation");
-    QPropertyAnimation* opacityAnim = new QPropertyAnimation(item, "opacity");
-
-    // 动画持续时间（3-5秒）
-    int duration = 3000 + QRandomGenerator::global()->bounded(2000);
-
-    // 位置动画（正弦曲线路径）
-    posAnim->setDuration(duration);
-    posAnim->setStartValue(QPointF(startX, -50));
-    posAnim->setEndValue(QPointF(
-        startX + QRandomGenerator::global()->bounded(400) - 200, // 随机水平偏移
-        m_scene->height() + 50));
-    posAnim->setEasingCurve(QEasingCurve::InQuad);
-
-    // 旋转动画
-    rotateAnim->setDuration(duration);
-    rotateAnim->setStartValue(0);
-    rotateAnim->setEndValue(QRandomGenerator::global()->bounded(360) + 360);
-
-    // 透明度动画
-    opacityAnim->setDuration(duration);
-    opacityAnim->setStartValue(1.0);
-    opacityAnim->setEndValue(0.0);
-
-    // 启动动画
-    QParallelAnimationGroup* group = new QParallelAnimationGroup(item);
-    group->addAnimation(posAnim);
-    group->addAnimation(rotateAnim);
-    group->addAnimation(opacityAnim);
-    group->start(QAbstractAnimation::DeleteWhenStopped);
-
-    // 动画完成时删除花瓣
-    connect(group, &QParallelAnimationGroup::finished,m_scene,[=]() {
-        m_scene->removeItem(item);
-        delete item;
-    });
+    if(!m_petals)
+    {
+        return;
+    }
+    PetalLayer::Petal petal;
+    petal.index = SimRandom::global()->bounded(m_petals->spriteCount());
+    petal.startX = int(SimRandom::global()->bounded(m_scene->width()));
+    petal.duration = 3000 + SimRandom::global()->bounded(2000);                       // 飘落时间（3-5秒）
+    petal.endX = petal.startX + SimRandom::global()->bounded(400) - 200;            // 随机水平偏移
+    petal.endRotation = SimRandom::global()->bounded(360) + 360;
+    petal.elapsed = 0;
+    m_petals->add(petal);
+    ShowStats::spawned(this, ShowStats::Emitted);
+}
+
+void EnframedScenery::saveState(QDataStream &out) const
+{
+    Screenwriter::saveState(out);
+    out << qint32(m_count);
+}
+
+void EnframedScenery::restoreState(QDataStream &in)
+{
+    Screenwriter::restoreState(in);
+    qint32 count;
+    in >> count;
+    m_count = count;
+}
+
+void EnframedScenery::saveItems(QDataStream &out) const
+{
+    const QVector<PetalLayer::Petal> petals = m_petals ? m_petals->petals() : QVector<PetalLayer::Petal>();
+    out << qint32(petals.count());
+    for (const PetalLayer::Petal &petal : petals) {
+        out << qint32(petal.index) << petal.startX << petal.endX << qint32(petal.endRotation)
+            << qint32(petal.duration) << qint32(petal.elapsed);
+    }
+}
+
+void EnframedScenery::restoreItems(QDataStream &in)
+{
+    createPetalLayer();
+    qint32 count;
+    in >> count;
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        PetalLayer::Petal petal;
+        qint32 index, endRotation, duration, elapsed;
+        in >> index >> petal.startX >> petal.endX >> endRotation >> duration >> elapsed;
+        petal.index = index;
+        petal.endRotation = endRotation;
+        petal.duration = duration;
+        petal.elapsed = elapsed;
+        if(m_petals && index >= 0 && index < m_petals->spriteCount() && duration > 0)
+        {
+            m_petals->add(petal);
+        }
+    }
 }
 
 
@@ -110,45 +219,100 @@ ParticleSystem::~ParticleSystem()
             delete affectors.at(i);
         }
     }
+    if(m_trail)
+    {
+        if(m_trail->scene())
+        {
+            m_trail->scene()->removeItem(m_trail);
+        }
+        delete m_trail;
+    }
 }
 
-void ParticleSystem::precondition()
+void ParticleSystem::addEmitter(Emitter *emitter)
 {
+    emitter->setOwner(this);
+    emitters.append(emitter);
+}
 
+//烘焙各发射器(含子发射器)的查找表，不访问场景
+void ParticleSystem::precondition()
+{
+    foreach (auto emitter, emitters)
+    {
+        emitter->prewarm();
+    }
 }
 
-void ParticleSystem::actOut()
+void ParticleSystem::spawn()
 {
     if(!m_shouldStop)
     {
-        emitParticles();
+        foreach (auto emitter, emitters)
+        {
+            emitter->setMediaPosition(m_mediaPosition);
+            emitter->emitParticle();
+        }
+    }
+    if(m_trail && !m_trail->scene() && !m_rehearsing)
+    {
+        m_scene->addItem(m_trail);
     }
-    bool containsParticle = false;
-    QList<QGraphicsItem*> items = m_scene->items();
-    for(QGraphicsItem *item : items) {
+    if(m_trail)
+    {
+        m_trail->setOpacity(m_opacity);
+    }
+}
+
+void ParticleSystem::actOut(const QList<QGraphicsItem*> &actors)
+{
+    QList<Particle*> particles;
+    particles.reserve(actors.count());
+    for(QGraphicsItem *item : actors) {
         if (auto p = dynamic_cast<Particle*>(item)) {
-            containsParticle = true;
-            // 应用干扰器
-            foreach(auto affector, affectors) {
-                affector->affect(p);
-            }
+            particles.append(p);
+        }
+    }
 
-            // 更新粒子
-            p->updatePaint();
+    // 干扰器帧准备
+    foreach(auto affector, affectors) {
+        affector->prepare(particles);
+    }
 
-            // 移除失效粒子
-            if (p->isDead()) {
-                m_scene->removeItem(p);
-                delete p;
-            }
+    for(Particle *p : particles) {
+        // 应用干扰器
+        foreach(auto affector, affectors) {
+            affector->affect(p);
+        }
+
+        // 更新粒子
+        p->updatePaint();
+
+        // 子发射器事件(生成的粒子进入生成队列)
+        if (Emitter *source = p->emitter()) {
+            source->raiseEvents(p, &m_spawnQueue);
         }
-        else {
 
+        // 移除失效粒子，存活粒子交给粒子层绘制(排练中不绘制)
+        if (p->isDead()) {
+            ShowStats::died(this);
+            m_scene->removeItem(p);
+            delete p;
+        }
+        else if (m_rehearsing) {
+            p->setFlag(QGraphicsItem::ItemHasNoContents);
         }
+        else if (m_layer) {
+            m_layer->append(p, m_opacity);
+        }
+    }
+    if(m_trail)
+    {
+        m_trail->advance();
     }
     if(m_shouldStop)
     {
-        if(!containsParticle)
+        if(particles.isEmpty() && m_spawnQueue.isEmpty())
         {
             m_exeunted = true;
             m_showing = false;
@@ -156,122 +320,261 @@ void ParticleSystem::actOut()
     }
 }
 
-void ParticleSystem::emitParticles()
+void ParticleSystem::saveState(QDataStream &out) const
 {
+    Screenwriter::saveState(out);
+    out << qint32(emitters.count());
     foreach (auto emitter, emitters)
     {
-        emitter->emitParticle();
+        emitter->saveState(out);
+    }
+
+    //干扰器状态各自打包，使用双精度(快照流为单精度，流场相位按单精度保存会偏离直接播放)
+    out << qint32(affectors.count());
+    foreach (auto affector, affectors)
+    {
+        QByteArray state;
+        QDataStream stream(&state, QIODevice::WriteOnly);
+        affector->saveState(stream);
+        out << state;
     }
 }
 
-CustomScenery::~CustomScenery()
+void ParticleSystem::restoreState(QDataStream &in)
+{
+    Screenwriter::restoreState(in);
+    qint32 count;
+    in >> count;
+    for (int i = 0; i < count && i < emitters.count(); ++i) {
+        emitters.at(i)->restoreState(in);
+    }
+
+    in >> count;
+    for (int i = 0; i < count; ++i) {
+        QByteArray state;
+        in >> state;
+        if(i < affectors.count())
+        {
+            QDataStream stream(state);
+            affectors.at(i)->restoreState(stream);
+        }
+    }
+}
+
+void ParticleSystem::saveItems(QDataStream &out) const
+{
+    writeParticles(out, m_scene, this, [this](const Particle *p) {
+        for (int i = 0; i < emitters.count(); ++i) {
+            if(p->emitter() == emitters.at(i) || (p->lifetimeLut() && emitters.at(i)->lifetimeLut() == p->lifetimeLut()))
+            {
+                return i;
+            }
+        }
+        return -1;
+    });
+}
+
+//恢复粒子并重新关联查找表、发射器与拖尾层
+void ParticleSystem::restoreItems(QDataStream &in)
 {
+    const QList<Particle*> particles = readParticles(in, m_scene, this);
+    for (Particle *p : particles) {
+        const int lut = p->data(0).toInt();
+        if(lut >= 0 && lut < emitters.count() && emitters.at(lut)->lifetimeLut())
+        {
+            p->setLifetimeLut(emitters.at(lut)->lifetimeLut());
+        }
+        if(lut >= 0 && lut < emitters.count())
+        {
+            p->setEmitter(emitters.at(lut));
+        }
+        if (auto flame = dynamic_cast<FlameParticle*>(p)) {
+            flame->setTrailLayer(m_trail);
+        }
+    }
+}
 
+CustomScenery::~CustomScenery()
+{
+    qDeleteAll(affectors);
 }
 
+//兰花、管道与烟花都在演出中逐帧生成，没有需要提前准备的资源
 void CustomScenery::precondition()
 {
-    addOrchid();
-    addPipe();
-    addFireWork();
+
 }
 
-void CustomScenery::actOut()
+void CustomScenery::spawn()
 {
     if(!m_shouldStop)
     {
-        precondition();
+        addOrchid();
+        addPipe();
+        addFireWork();
+    }
+}
+
+void CustomScenery::actOut(const QList<QGraphicsItem*> &actors)
+{
+    if(!affectors.isEmpty())
+    {
+        QList<Particle*> particles;
+        for(QGraphicsItem *item : actors) {
+            if (auto p = dynamic_cast<Particle*>(item)) {
+                particles.append(p);
+            }
+        }
+        foreach(auto affector, affectors) {
+            affector->prepare(particles);
+        }
     }
-    bool containsParticle = false;
-    QList<QGraphicsItem*> items = m_scene->items();
-    for(QGraphicsItem *item : items) {
+
+    for(QGraphicsItem *item : actors) {
+        if(item->opacity() != m_opacity)
+        {
+            item->setOpacity(m_opacity);
+        }
         if (auto p = dynamic_cast<Particle*>(item)) {
-            containsParticle = true;
+            // 应用干扰器
+            foreach(auto affector, affectors) {
+                affector->affect(p);
+            }
 
             // 更新粒子
             p->updatePaint();
 
-            // 移除失效粒子
+            // 移除失效粒子，存活粒子交给粒子层绘制
             if (p->isDead()) {
+                ShowStats::died(this);
                 m_scene->removeItem(p);
                 delete p;
             }
+            else if (m_layer) {
+                m_layer->append(p, m_opacity);
+            }
         }
-        if(OrchidItem *orchid = dynamic_cast<OrchidItem*>(item))
+        else if(OrchidItem *orchid = dynamic_cast<OrchidItem*>(item))
         {
-            containsParticle = true;
+            // 推进兰花绘制进度，结束后移除
+            orchid->updatePaint();
+            if(orchid->isFinished())
+            {
+                ShowStats::died(this);
+                m_scene->removeItem(orchid);
+                delete orchid;
+            }
         }
     }
-    if(m_shouldStop)
+    if(m_shouldStop && actors.isEmpty())
     {
-        if(!containsParticle)
-        {
-            m_exeunted = true;
-            m_showing = false;
+        m_exeunted = true;
+        m_showing = false;
+    }
+}
+
+void CustomScenery::saveState(QDataStream &out) const
+{
+    Screenwriter::saveState(out);
+    out << qint32(m_orchidCount) << qint32(m_pipeCount);
+}
+
+void CustomScenery::restoreState(QDataStream &in)
+{
+    Screenwriter::restoreState(in);
+    qint32 orchidCount, pipeCount;
+    in >> orchidCount >> pipeCount;
+    m_orchidCount = orchidCount;
+    m_pipeCount = pipeCount;
+}
+
+void CustomScenery::saveItems(QDataStream &out) const
+{
+    writeParticles(out, m_scene, this, [](const Particle *) {return -1;});
+    QList<OrchidItem*> orchids;
+    const QList<QGraphicsItem*> items = m_scene->items();
+    for (QGraphicsItem *item : items) {
+        auto orchid = dynamic_cast<OrchidItem*>(item);
+        if (orchid && orchid->owner() == this) {
+            orchids.append(orchid);
         }
     }
+    out << qint32(orchids.count());
+    for (const OrchidItem *orchid : std::as_const(orchids)) {
+        orchid->saveState(out);
+    }
+}
+
+void CustomScenery::restoreItems(QDataStream &in)
+{
+    readParticles(in, m_scene, this);
+    qint32 count;
+    in >> count;
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        OrchidItem::restore(in, m_scene)->setOwner(this);
+    }
 }
 
 void CustomScenery::addOrchid()
 {
-    static int count = 0;
-    count++;
-    if(count>12)
+    m_orchidCount++;
+    if(m_orchidCount>12)
     {
-        count = 0;
+        m_orchidCount = 0;
 
         //绘图时间
-        int delay = QRandomGenerator::global()->bounded(5,40);
-        int execTime = QRandomGenerator::global()->bounded(32,40);
-        int quitTime = QRandomGenerator::global()->bounded(20,35);
+        int delay = SimRandom::global()->bounded(5,40);
+        int execTime = SimRandom::global()->bounded(32,40);
+        int quitTime = SimRandom::global()->bounded(20,35);
 
         //初始位置
-        float x = QRandomGenerator::global()->bounded(-60,60) + m_scene->sceneRect().width()/2;
-        float y = QRandomGenerator::global()->bounded(100,200) + m_scene->sceneRect().height();
+        float x = SimRandom::global()->bounded(-60,60) + m_scene->sceneRect().width()/2;
+        float y = SimRandom::global()->bounded(100,200) + m_scene->sceneRect().height();
 
         //初速度
-        float vy = QRandomGenerator::global()->bounded(30.0) - 110.0;
-        float vx = QRandomGenerator::global()->bounded(40.0) - 20.0;
+        float vy = SimRandom::global()->bounded(30.0) - 110.0;
+        float vx = SimRandom::global()->bounded(40.0) - 20.0;
 
         //渐变色
-        QColor color1(0,128+QRandomGenerator::global()->bounded(128),128+QRandomGenerator::global()->bounded(128),255);
-        QColor color2(128,128+QRandomGenerator::global()->bounded(128),128+QRandomGenerator::global()->bounded(128),255);
+        QColor color1(0,128+SimRandom::global()->bounded(128),128+SimRandom::global()->bounded(128),255);
+        QColor color2(128,128+SimRandom::global()->bounded(128),128+SimRandom::global()->bounded(128),255);
 
         //轨迹宽度
-        float width1 = 10.0 + QRandomGenerator::global()->bounded(10.0);
+        float width1 = 10.0 + SimRandom::global()->bounded(10.0);
         float width2 = 0.1;
 
         //轨迹长度
-        int length = QRandomGenerator::global()->bounded(100,150);
+        int length = SimRandom::global()->bounded(100,150);
 
         OrchidItem *orchid = new OrchidItem(QVector2D(x,y),QVector2D(vx,vy),m_scene);
         orchid->setOrchid(length,color1,color2,width1,width2);
         orchid->setPainting(delay,execTime,quitTime);
+        orchid->setOwner(this);
+        ShowStats::spawned(this, ShowStats::Emitted);
         orchid->start();
     }
 }
 
 void CustomScenery::addPipe()
 {
-    static int count = 0;
-    count++;
-    if(count>8)
+    m_pipeCount++;
+    if(m_pipeCount>8)
     {
-        count = 0;
+        m_pipeCount = 0;
 
-        float x = QRandomGenerator::global()->bounded(m_scene->sceneRect().width());
-        float y = QRandomGenerator::global()->bounded(100) + m_scene->sceneRect().height();
-        float size1 = QRandomGenerator::global()->bounded(20) + 20;
+        float x = SimRandom::global()->bounded(m_scene->sceneRect().width());
+        float y = SimRandom::global()->bounded(100) + m_scene->sceneRect().height();
+        float size1 = SimRandom::global()->bounded(20) + 20;
 
         int r,g,b,a;
-        r = QRandomGenerator::global()->bounded(256);
-        g = QRandomGenerator::global()->bounded(256);
-        b = QRandomGenerator::global()->bounded(256);
-        a = QRandomGenerator::global()->bounded(128)+128;
+        r = SimRandom::global()->bounded(256);
+        g = SimRandom::global()->bounded(256);
+        b = SimRandom::global()->bounded(256);
+        a = SimRandom::global()->bounded(128)+128;
 
         //
-        qreal radian = (M_PI / 180) * (-120 + QRandomGenerator::global()->bounded(60));
-        qreal length = 2.0 + QRandomGenerator::global()->bounded(3.0);
+        qreal radian = (M_PI / 180) * (-120 + SimRandom::global()->bounded(60));
+        qreal length = 2.0 + SimRandom::global()->bounded(3.0);
         QVector2D offset(qCos(radian),qSin(radian));
         QPointF point(x,y);
 
@@ -283,9 +586,15 @@ void CustomScenery::addPipe()
         params.startColor = QColor(r,g,b,a);                        //当前颜色
         params.endColor = QColor(r,g,b,0);                          //结束颜色
         params.size = size1;
-        params.lifeTime = 100 + QRandomGenerator::global()->bounded(100);
+        params.lifeTime = 100 + SimRandom::global()->bounded(100);
         Particle* p = new Particle(params);
+        p->setOwner(this);
+        ShowStats::spawned(this, ShowStats::Emitted);
         p->setZValue(-1);
+        if(m_layer)
+        {
+            p->setFlag(QGraphicsItem::ItemHasNoContents);
+        }
         m_scene->addItem(p);
     }
 }
@@ -3,6 +3,10 @@
 
 #include <QObject>
 #include <QGraphicsScene>
+#include <QDataStream>
+
+#include "graphicsitems.h"
+#include "showstats.h"
 
 class Emitter;
 class Affector;
@@ -18,16 +22,56 @@ public:
     void start(){m_showing = true;}
     bool isShowing(){return m_showing;}
     void shouldStop(){m_shouldStop = true;}
+    bool isStopping() const {return m_shouldStop;}
     bool isExecuted(){return m_exeunted;}
 
-    virtual void precondition() = 0;    //事先准备
-    virtual void actOut() = 0;          //演出
+    //优先级：超出帧预算时，只有最高优先级的编剧继续生成新元素，其余编剧只推进已有元素
+    void setPriority(int priority){m_priority = priority;}
+    int priority() const {return m_priority;}
+
+    //事先准备(预热)：出场前由时间线线程提前调用，只做不访问场景、不使用SimRandom的准备(解码图片、烘焙查找表等)
+    virtual void precondition() = 0;
+
+    //提前排练：预热后即加入节目单隐藏演出，到出场时间才显示(例如出场时萤火虫已在空中)
+    void setRehearse(bool rehearse){m_rehearse = rehearse;}
+    bool rehearses() const {return m_rehearse;}
+    void setRehearsing(bool rehearsing){m_rehearsing = rehearsing;}
+    bool isRehearsing() const {return m_rehearsing;}
+
+    //整体透明度(由过渡在显示帧中设置，演出时应用到本编剧的元素)
+    void setOpacity(qreal opacity){m_opacity = opacity;}
+    qreal opacity() const {return m_opacity;}
+    virtual void spawn(){}                                          //生成本帧的新元素
+    virtual void actOut(const QList<QGraphicsItem*> &actors) = 0;   //演出：推进调度器分派来的、属于本编剧的元素
+
+    //快照：编剧自身状态与其驱动的场景元素分开保存，每个编剧只保存属于自己的元素
+    void setSceneId(int id){m_sceneId = id;}
+    int sceneId() const {return m_sceneId;}
+    virtual void saveState(QDataStream &out) const;
+    virtual void restoreState(QDataStream &in);
+    virtual void saveItems(QDataStream &out) const {Q_UNUSED(out)}
+    virtual void restoreItems(QDataStream &in){Q_UNUSED(in)}
+    virtual void skipTime(int msecs){Q_UNUSED(msecs)}              //快进时推进依赖墙钟的动画
+    void setMediaPosition(qint64 position){m_mediaPosition = position;}    //每帧演出前设置当前音乐位置(毫秒)
+    void setParticleLayer(ParticleLayer *layer){m_layer = layer;}          //设置后粒子交由粒子层统一光栅化
+    ParticleLayer *particleLayer() const {return m_layer;}
+    ShowStats::System &stats() const {return m_stats;}                      //本编剧的演出统计
+    SpawnQueue &spawnQueue(){return m_spawnQueue;}                          //演出中生成的粒子，由调度器在本帧末尾统一加入场景
 
 protected:
     QGraphicsScene *m_scene;
+    ParticleLayer *m_layer = nullptr;
+    int m_sceneId = -1;
+    int m_priority = 0;
+    qint64 m_mediaPosition = -1;
     bool m_showing = false;
     bool m_shouldStop = false;
     bool m_exeunted = false;
+    bool m_rehearse = false;
+    bool m_rehearsing = false;
+    qreal m_opacity = 1.0;
+    mutable ShowStats::System m_stats;
+    SpawnQueue m_spawnQueue;
 
 };
 
@@ -38,14 +82,25 @@ class EnframedScenery : public Screenwriter
 public:
     using Screenwriter::Screenwriter;
     ~EnframedScenery();
-    void addDynamicPixmap(const QPixmap &pix){dynamicPixmaps.append(pix);}      //添加动态图片
+    void setPetalSheet(const QString &fileName, const QSize &cell);  //设置花瓣贴图集(按cell大小逐行切片)，在预热或首次演出时解码
 
     void precondition() override;
-    void actOut() override;
+    void spawn() override;
+    void actOut(const QList<QGraphicsItem*> &actors) override;
+
+    void saveState(QDataStream &out) const override;
+    void restoreState(QDataStream &in) override;
+    void saveItems(QDataStream &out) const override;
+    void restoreItems(QDataStream &in) override;
 
 private:
     void createFalling();
-    QVector<QPixmap> dynamicPixmaps;
+    void createPetalLayer();
+    QString m_sheetFile;
+    QImage m_sheet;
+    QSize m_cell;
+    PetalLayer *m_petals = nullptr;
+    int m_count = 0;
 
 };
 
@@ -56,16 +111,23 @@ class ParticleSystem : public Screenwriter
 public:
     using Screenwriter::Screenwriter;
     ~ParticleSystem();
-    void addEmitter(Emitter* emitter) { emitters.append(emitter); }       //添加粒子发射器
+    void addEmitter(Emitter* emitter);                                      //添加粒子发射器
     void addAffector(Affector* affector) { affectors.append(affector); }  //添加粒子干扰器
+    void setTrailLayer(TrailLayer* trail) { m_trail = trail; }             //设置拖尾层(由粒子系统持有)
 
     void precondition() override;
-    void actOut() override;
+    void spawn() override;
+    void actOut(const QList<QGraphicsItem*> &actors) override;
+
+    void saveState(QDataStream &out) const override;
+    void restoreState(QDataStream &in) override;
+    void saveItems(QDataStream &out) const override;
+    void restoreItems(QDataStream &in) override;
 
 private:
-    void emitParticles();
     QList<Emitter*> emitters;
     QList<Affector*> affectors;
+    TrailLayer *m_trail = nullptr;
 };
 
 
@@ -75,13 +137,23 @@ class CustomScenery : public Screenwriter
 public:
     using Screenwriter::Screenwriter;
     ~CustomScenery();
+    void addAffector(Affector* affector) { affectors.append(affector); }  //添加泡影粒子的干扰器
     void precondition() override;
-    void actOut() override;
+    void spawn() override;
+    void actOut(const QList<QGraphicsItem*> &actors) override;
+
+    void saveState(QDataStream &out) const override;
+    void restoreState(QDataStream &in) override;
+    void saveItems(QDataStream &out) const override;
+    void restoreItems(QDataStream &in) override;
 
 private:
     void addOrchid();
     void addPipe();
     void addFireWork();
+    QList<Affector*> affectors;
+    int m_orchidCount = 0;
+    int m_pipeCount = 0;
 };
 
 
@@ -1,97 +1,525 @@
 #include "sequencer.h"
 #include "screenwriter.h"
+#include "scheduler.h"
+#include "framedriver.h"
+#include "showstats.h"
 #include "graphicsitems.h"
 #include "emitter.h"
 #include "affector.h"
+#include "audioanalyzer.h"
+#include "transition.h"
+#include "synclatency.h"
 
 #include <QDebug>
 #include <QFileInfo>
-#include <QPropertyAnimation>
 #include <QUrl>
 #include <QDesktopServices>
+#include <QDataStream>
+#include <algorithm>
+#include "simrandom.h"
 
-Sequencer::Sequencer(QGraphicsScene *scene, QObject *parent)
+Sequencer::Sequencer(QGraphicsScene *scene, QObject *parent, bool live)
     : QThread(parent)
     , m_scene(scene)
+    , m_prewarmLead(PREWARM_LEAD)
+    , m_transitions(new Transitions)
+    , m_scheduler(new Scheduler(scene))
 {
     connect(this,&Sequencer::backgroundLoading,this,&Sequencer::onBackgroundLoading);
     connect(this,&Sequencer::backgroundChanged,this,&Sequencer::onBackgroundChanged);
 
-    m_timer = new QTimer(this);
-    connect(m_timer,&QTimer::timeout,this,&Sequencer::onTimerTimeout);
-    m_timer->start(20);
+    buildTimeline();
+
+    m_particleLayer = new ParticleLayer(m_scene->sceneRect());
+    m_scene->addItem(m_particleLayer);
+    m_scheduler->setParticleLayer(m_particleLayer);
+
+    m_beatMap.reset(new BeatMapSlot);
+    m_analyzer = new AudioAnalyzer(this);
+    connect(m_analyzer,&AudioAnalyzer::finished,this,[this](QSharedPointer<const BeatMap> beatMap) {
+        m_beatMap->set(beatMap);
+        qDebug() << "节拍分析完成 BPM:" << beatMap->bpm() << "节拍数:" << beatMap->beats().count();
+    });
+
+    m_frameDriver = new FrameDriver(this);
+    connect(m_frameDriver,&FrameDriver::frame,this,&Sequencer::onFrame);
+    if(live)
+    {
+        m_analyzer->analyze(":/music.aac");
+        m_frameDriver->start();
+    }
 }
 
 Sequencer::~Sequencer()
 {
-    if(!m_screenwriters.isEmpty())
-    {
-        for (int i = 0; i < m_screenwriters.count(); ++i) {
-            delete m_screenwriters.at(i);
-        }
-        m_screenwriters.clear();
-    }
+    qDeleteAll(m_prewarmed);
+    delete m_transitions;
+    delete m_scheduler;
 }
 
 void Sequencer::setCurrentTimestamp(int timestamp)
 {
+    QMutexLocker locker(&m_timelineMutex);
     m_timestamp = timestamp;
+    m_timelineChanged.wakeAll();
 }
 
-void Sequencer::run()
+void Sequencer::setCurrentPosition(qint64 position)
 {
-    m_timestamp = 0;
-    emit backgroundLoading();
+    QMutexLocker locker(&m_timelineMutex);
+    m_position = position;
+    m_positionClock.start();
+}
 
-    addEvent(3,std::bind(&Sequencer::backgroundFadein,this));       //背景淡入
-    addEvent(5,std::bind(&Sequencer::sakura,this));                 //花瓣飘落
-    addEvent(50,std::bind(&Sequencer::endOfCurrentScene,this));      //花瓣飘落结束
-    addEvent(55,std::bind(&Sequencer::sceneTransition2,this));      //切换夜景(65)
-    addEvent(60,std::bind(&Sequencer::firefly,this));               //萤火虫(70)
-    addEvent(65,std::bind(&Sequencer::backgroundFadeout,this));     //背景淡出(75)
-    addEvent(85,std::bind(&Sequencer::endOfCurrentScene,this));      //萤火虫结束(85)
-    addEvent(90,std::bind(&Sequencer::spiralParticle,this));        //粒子环绕(90)
-    addEvent(110,std::bind(&Sequencer::endOfCurrentScene,this));     //粒子环绕结束(110)
-    addEvent(115,std::bind(&Sequencer::fireworks,this));            //烟花(120)
-    addEvent(180,std::bind(&Sequencer::endOfCurrentScene,this));     //烟花结束(180)
-    addEvent(182,std::bind(&Sequencer::sceneTransition3,this));     //切换白景(190)
-    addEvent(186,std::bind(&Sequencer::orchidBubbleFireworks,this));//兰花(185)
+qint64 Sequencer::currentPosition() const
+{
+    if(!m_positionClock.isValid())
+    {
+        return m_position;
+    }
+    return m_position + std::min<qint64>(m_positionClock.elapsed(), 1000);
+}
+
+void Sequencer::buildTimeline()
+{
+    addEvent(3,std::bind(&Sequencer::backgroundFadein,this),"backgroundFadein");            //背景淡入
+    addCue(5,SakuraScene);                                                                  //花瓣飘落
+    addEvent(50,std::bind(&Sequencer::endOfCurrentScene,this),"endOfCurrentScene");         //花瓣飘落结束
+    addEvent(55,std::bind(&Sequencer::sceneTransition2,this),"sceneTransition2");           //切换夜景(65)
+    addCue(60,FireflyScene);                                                                //萤火虫(70)
+    addEvent(65,std::bind(&Sequencer::backgroundFadeout,this),"backgroundFadeout");         //背景淡出(75)
+    addEvent(85,std::bind(&Sequencer::endOfCurrentScene,this),"endOfCurrentScene");         //萤火虫结束(85)
+    addCue(90,SpiralScene);                                                                 //粒子环绕(90)
+    addEvent(110,std::bind(&Sequencer::endOfCurrentScene,this),"endOfCurrentScene");        //粒子环绕结束(110)
+    addCue(115,FireworksScene);                                                             //烟花(120)
+    addEvent(180,std::bind(&Sequencer::endOfCurrentScene,this),"endOfCurrentScene");        //烟花结束(180)
+    addEvent(182,std::bind(&Sequencer::sceneTransition3,this),"sceneTransition3");          //切换白景(190)
+    addCue(186,OrchidScene);                                                                //兰花(185)
+    addEvent(186,std::bind(&Sequencer::openReadme,this),"openReadme");                      //留言
+
+    //预热事件提前插入，按时间戳稳定排序(同一时刻保持添加顺序)
+    std::stable_sort(m_events.begin(), m_events.end(), [](const TimelineEvent& a, const TimelineEvent& b) {
+        return a.timestamp < b.timestamp;
+    });
+}
 
+void Sequencer::run()
+{
+    //跳转后继续执行时间线，否则从头开始
+    if(!m_resuming)
+    {
+        QMutexLocker eventLocker(&m_eventMutex);
+        QMutexLocker locker(&m_timelineMutex);
+        m_timestamp = 0;
+        m_nextEvent = 0;
+        emit backgroundLoading();
+    }
+    m_resuming = false;
 
     qDebug() << "任务已开始";
 
-    auto eventIter = m_events.begin();
-    while (!isInterruptionRequested() && (eventIter != m_events.end())) {
-        if (m_timestamp >= eventIter->timestamp) {
-            eventIter->callback();
-            eventIter = m_events.erase(eventIter);
+    //事件之间不轮询：等待音乐进度推进(setCurrentTimestamp)或中断(stopTimeline)时被唤醒
+    QMutexLocker locker(&m_timelineMutex);
+    while (!isInterruptionRequested() && (m_nextEvent < m_events.count())) {
+        if (m_timestamp >= m_events.at(m_nextEvent).timestamp) {
+            //事件下标在执行前推进，整个事件在m_eventMutex内完成，快照看到的要么是事件之前、要么是之后的状态
+            locker.unlock();
+            QMutexLocker eventLocker(&m_eventMutex);
+            locker.relock();
+            const TimelineEvent &event = m_events.at(m_nextEvent);
+            SyncLatency::global()->eventExecuted(event.name, qint64(event.timestamp) * 1000, currentPosition());
+            m_nextEvent++;
+            locker.unlock();
+            event.callback();
+            eventLocker.unlock();
+            QMetaObject::invokeMethod(this, &Sequencer::wake, Qt::QueuedConnection);
+            locker.relock();
+            continue;
         }
-        QThread::msleep(10);
+        m_timelineChanged.wait(&m_timelineMutex, TIMELINE_MAX_WAIT);
     }
+    locker.unlock();
 
     qDebug() << "任务已结束";
 }
 
-void Sequencer::onTimerTimeout()
+void Sequencer::onFrame(qint64 timestamp)
+{
+    ShowStats::global()->frameStarted();
+    SyncLatency::global()->frameStarted(currentPosition(), m_frameDriver->frameCount());
+
+    //模拟保持固定步长，显示帧之间的剩余时间用于插值绘制
+    const qint64 tick = qint64(TICK_INTERVAL) * 1000000;
+    const qint64 elapsed = m_lastFrame < 0 ? 0 : timestamp - m_lastFrame;
+    m_accumulator = m_lastFrame < 0 ? tick : m_accumulator + elapsed;
+    m_accumulator = std::min(m_accumulator, MAX_CATCHUP_TICKS * tick);
+    m_lastFrame = timestamp;
+    while (m_accumulator >= tick) {
+        onTick();
+        m_accumulator -= tick;
+    }
+    m_particleLayer->setInterpolation(qreal(m_accumulator) / tick);
+    m_transitions->advance(elapsed / 1e6);             //过渡按实际经过时间推进，与模拟步长无关
+    m_particleLayer->submit();
+    m_scene->update();
+
+    //空闲(场景之间、演出结束后)时停止出帧，下一个时间线事件或跳转时再恢复
+    if(isIdle())
+    {
+        m_particleLayer->flush();
+        m_frameDriver->stop();
+        m_suspended = true;
+        qDebug() << "帧驱动挂起";
+    }
+}
+
+void Sequencer::wake()
+{
+    if(!m_suspended)
+    {
+        return;
+    }
+    m_suspended = false;
+    m_lastFrame = -1;
+    m_frameDriver->start();
+    qDebug() << "帧驱动恢复";
+}
+
+void Sequencer::curtain()
+{
+    SyncLatency::global()->finishRun();
+    m_scheduler->stopAll();
+    wake();
+}
+
+bool Sequencer::isIdle() const
+{
+    return m_scheduler->isEmpty() && m_transitions->isEmpty();
+}
+
+void Sequencer::stopTimeline()
+{
+    if(!isRunning())
+    {
+        return;
+    }
+    requestInterruption();
+    {
+        QMutexLocker locker(&m_timelineMutex);
+        m_timelineChanged.wakeAll();
+    }
+    wait();
+}
+
+void Sequencer::onTick()
+{
+    //定期保存快照
+    if(isRunning())
+    {
+        //时间线事件正在执行时推迟到下一个模拟步
+        const qint64 position = currentPosition();
+        if(position >= m_nextSnapshot && m_eventMutex.tryLock())
+        {
+            m_snapshots.insert(position, saveSnapshot());
+            m_eventMutex.unlock();
+            m_nextSnapshot = position - position % SNAPSHOT_INTERVAL + SNAPSHOT_INTERVAL;
+        }
+    }
+    actOut(false);
+}
+
+void Sequencer::actOut(bool render)
+{
+    m_scheduler->setMediaPosition(m_fastForwarding ? m_position : currentPosition());
+    m_scheduler->tick();                //演出
+    if(render)
+    {
+        m_scene->update();
+    }
+}
+
+void Sequencer::step()
+{
+    m_fastForwarding = true;
+    m_position += TICK_INTERVAL;
+    m_scheduler->skipTime(TICK_INTERVAL);
+    m_transitions->advance(TICK_INTERVAL);
+    actOut(false);
+    m_particleLayer->submit();
+    m_fastForwarding = false;
+}
+
+void Sequencer::setPipelined(bool pipelined)
+{
+    m_particleLayer->setPipelined(pipelined);
+}
+
+void Sequencer::seek(qint64 position)
+{
+    position = std::max<qint64>(position, 0);
+    auto snapshot = m_snapshots.upperBound(position);
+    if(snapshot == m_snapshots.begin())
+    {
+        qDebug() << "没有可用的快照";
+        return;
+    }
+    --snapshot;
+
+    //暂停时间线与帧驱动
+    m_frameDriver->stop();
+    stopTimeline();
+
+    restoreSnapshot(snapshot.value());
+
+    //不渲染地快进到目标时间
+    m_fastForwarding = true;
+    qint64 current = snapshot.key();
+    while (current < position) {
+        current += TICK_INTERVAL;
+        m_position = current;
+        m_timestamp = int(current / 1000);
+        while (m_nextEvent < m_events.count() && m_events.at(m_nextEvent).timestamp <= m_timestamp) {
+            m_nextEvent++;
+            m_events.at(m_nextEvent - 1).callback();
+        }
+        m_scheduler->skipTime(TICK_INTERVAL);
+        m_transitions->advance(TICK_INTERVAL);
+        actOut(false);
+    }
+    m_fastForwarding = false;
+
+    m_timestamp = int(position / 1000);
+    setCurrentPosition(position);
+    m_nextSnapshot = position - position % SNAPSHOT_INTERVAL + SNAPSHOT_INTERVAL;
+    m_scene->update();
+    emit seeked(position);
+
+    //继续执行时间线
+    m_resuming = true;
+    start();
+    m_lastFrame = -1;
+    m_suspended = false;
+    m_frameDriver->start();
+}
+
+//快照格式：头部、时间线位置、背景、编剧列表及各自的状态与场景元素、随机数状态
+QByteArray Sequencer::saveSnapshot() const
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    out << quint32(0x50445350) << quint16(SNAPSHOT_VERSION);
+    {
+        QMutexLocker locker(&m_timelineMutex);
+        out << qint32(m_timestamp) << qint32(m_nextEvent);
+    }
+
+    qreal backgroundOpacity = 0;
+    foreach(auto item, m_scene->items()) {
+        if (auto bg = dynamic_cast<BackgroundItem*>(item)) {
+            backgroundOpacity = bg->opacity();
+        }
+    }
+    out << backgroundOpacity << m_scene->backgroundBrush().color();
+
+    const QList<Screenwriter*> screenwriters = m_scheduler->screenwriters();
+    out << qint32(screenwriters.count());
+    foreach (auto screenwriter, screenwriters) {
+        out << qint32(screenwriter->sceneId());
+        screenwriter->saveState(out);
+        screenwriter->saveItems(out);
+    }
+
+    out << SimRandom::global()->state();
+    return qCompress(data);
+}
+
+void Sequencer::restoreSnapshot(const QByteArray &snapshot)
 {
-    if(!m_screenwriters.isEmpty())
+    QDataStream in(qUncompress(snapshot));
+    in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    quint32 magic;
+    quint16 version;
+    in >> magic >> version;
+    if(magic != 0x50445350 || version != SNAPSHOT_VERSION)
     {
-        if(m_screenwriters.first()->isShowing())
+        qDebug() << "快照格式错误";
+        return;
+    }
+
+    //时间线线程已停止，加锁只为与快照保存互斥
+    QMutexLocker eventLocker(&m_eventMutex);
+    qint32 timestamp, nextEvent;
+    in >> timestamp >> nextEvent;
+    {
+        QMutexLocker locker(&m_timelineMutex);
+        m_timestamp = timestamp;
+        m_nextEvent = nextEvent;
+    }
+
+    //背景：停止正在进行的过渡
+    qreal backgroundOpacity;
+    QColor backgroundColor;
+    in >> backgroundOpacity >> backgroundColor;
+    m_transitions->clear();
+    foreach(auto item, m_scene->items()) {
+        if (auto bg = dynamic_cast<BackgroundItem*>(item)) {
+            bg->setOpacity(backgroundOpacity);
+        }
+    }
+    m_scene->setBackgroundBrush(backgroundColor);
+
+    //清空当前演出(包括尚未出场的预热编剧)
+    m_scheduler->clear();
+    qDeleteAll(m_prewarmed);
+    m_prewarmed.clear();
+    foreach(auto item, m_scene->items()) {
+        if (dynamic_cast<Particle*>(item) || dynamic_cast<OrchidItem*>(item)) {
+            m_scene->removeItem(item);
+            delete item;
+        }
+    }
+
+    //重建编剧并恢复状态
+    qint32 count;
+    in >> count;
+    for (int i = 0; i < count; ++i) {
+        qint32 sceneId;
+        in >> sceneId;
+        const int built = m_scheduler->screenwriters().count();
+        buildScene(sceneId);
+        const QList<Screenwriter*> screenwriters = m_scheduler->screenwriters();
+        if(screenwriters.count() == built)
         {
-            m_screenwriters.first()->actOut();         //演出
-            m_scene->update();
+            qDebug() << "未知场景" << sceneId;
+            break;
         }
-        if(m_screenwriters.first()->isExecuted())      //演出结束
+        screenwriters.last()->restoreState(in);
+        screenwriters.last()->restoreItems(in);
+    }
+
+    quint64 state;
+    in >> state;
+    SimRandom::global()->setState(state);
+}
+
+Screenwriter *Sequencer::createScene(int sceneId)
+{
+    switch (sceneId) {
+    case SakuraScene:
+        return sakura();
+    case FireflyScene:
+        return firefly();
+    case SpiralScene:
+        return spiralParticle();
+    case FireworksScene:
+        return fireworks();
+    case OrchidScene:
+        return orchidBubbleFireworks();
+    default:
+        return nullptr;
+    }
+}
+
+void Sequencer::buildScene(int sceneId)
+{
+    Screenwriter *screenwriter = createScene(sceneId);
+    if(!screenwriter)
+    {
+        return;
+    }
+    screenwriter->precondition();
+    screenwriter->start();
+    m_scheduler->add(screenwriter);
+    qDebug() << screenwriter;
+}
+
+//出场前PREWARM_LEAD秒：创建编剧并预热(时间线线程)，需要排练的编剧立即隐藏加入节目单
+void Sequencer::prewarm(int sceneId)
+{
+    if(m_prewarmed.contains(sceneId))
+    {
+        return;
+    }
+    Screenwriter *screenwriter = createScene(sceneId);
+    if(!screenwriter)
+    {
+        return;
+    }
+    screenwriter->precondition();
+    if(screenwriter->rehearses())
+    {
+        screenwriter->setRehearsing(true);
+        screenwriter->start();
+        m_scheduler->add(screenwriter);
+        qDebug() << "排练" << screenwriter;
+        return;
+    }
+    m_prewarmed.insert(sceneId, screenwriter);
+}
+
+//出场：优先使用排练中或已预热的编剧，没有时(例如跳转后)当场创建
+//平滑过渡时新场景从透明开始，与上一个场景交叉淡入淡出
+void Sequencer::cue(int sceneId)
+{
+    const bool smooth = m_smoothTransitions.load(std::memory_order_relaxed);
+    Screenwriter *screenwriter = m_scheduler->reveal(sceneId, 0.0);
+    if(!screenwriter)
+    {
+        screenwriter = m_prewarmed.take(sceneId);
+        if(!screenwriter)
         {
-            delete m_screenwriters.first();
-            m_screenwriters.removeFirst();
-            qDebug() << "下一个节目";
+            screenwriter = createScene(sceneId);
+            if(!screenwriter)
+            {
+                return;
+            }
+            screenwriter->precondition();
         }
+        screenwriter->setOpacity(smooth ? 0.0 : 1.0);      //加入节目单前设置，第一帧就不会以不透明度1出现
+        screenwriter->start();
+        m_scheduler->add(screenwriter);
+        qDebug() << screenwriter;
+        if(!smooth)
+        {
+            return;
+        }
+    }
+    else if(!smooth)
+    {
+        m_transitions->add(new WriterFade(screenwriter, 0.0, 1.0, REVEAL_FADE));
+        return;
     }
+
+    //上一个场景的查找、收场与淡出都在调度器持锁期间完成，期间它不会退出节目单
+    const bool handedOver = m_scheduler->handOver(screenwriter, [this, screenwriter](Screenwriter *leaving) {
+        m_transitions->crossFade(leaving, screenwriter, CROSS_FADE);
+    });
+    if(!handedOver)
+    {
+        m_transitions->add(new WriterFade(screenwriter, 0.0, 1.0, CROSS_FADE));
+    }
+}
+
+void Sequencer::setPrewarmLead(int seconds)
+{
+    m_prewarmLead = std::max(0, seconds);
+    m_events.clear();
+    buildTimeline();
+}
+
+void Sequencer::addCue(int timestamp, int sceneId)
+{
+    addEvent(std::max(0, timestamp - m_prewarmLead),std::bind(&Sequencer::prewarm,this,sceneId),QString("prewarm:%1").arg(sceneId));
+    addEvent(timestamp,std::bind(&Sequencer::cue,this,sceneId),QString("cue:%1").arg(sceneId));
 }
 
 void Sequencer::onBackgroundLoading()
 {
+    //重新开始演出，旧快照作废
+    m_snapshots.clear();
+    m_nextSnapshot = 0;
+
     QList<QGraphicsItem*> items = m_scene->items();
     for (QGraphicsItem *item : items) {
         if (dynamic_cast<BackgroundItem*>(item)) {
@@ -111,18 +539,14 @@ void Sequencer::onBackgroundChanged(qreal start, qreal end, int duration)
 {
     foreach(auto item, m_scene->items()) {
         if (auto bg = dynamic_cast<BackgroundItem*>(item)) {
-            QPropertyAnimation* anim = new QPropertyAnimation(bg, "opacity");
-            anim->setDuration(duration);
-            anim->setStartValue(start);
-            anim->setEndValue(end);
-            anim->start(QAbstractAnimation::DeleteWhenStopped);
+            m_transitions->add(new OpacityRamp(bg, start, end, duration));
         }
     }
 }
 
-void Sequencer::addEvent(int timestamp, std::function<void ()> callback)
+void Sequencer::addEvent(int timestamp, std::function<void ()> callback, const QString &name)
 {
-    m_events.push_back({timestamp, callback});
+    m_events.push_back({timestamp, callback, name});
     // 按时间戳排序
     // std::sort(events.begin(), events.end(), [](const TimelineEvent& a, const TimelineEvent& b) {
     //     return a.timestamp < b.timestamp;
@@ -139,23 +563,18 @@ void Sequencer::backgroundFadeout()
     emit backgroundChanged(1.0,0.0,2000);
 }
 
-void Sequencer::sakura()
+Screenwriter *Sequencer::sakura()
 {
     qDebug() << "开始绘制樱花";
     EnframedScenery *sakuraScene = new EnframedScenery(m_scene);
 
-    QPixmap petals(":/petal.png");
-    for (int i = 0; i < 4; ++i) {
-        for (int j = 0; j < 3; ++j) {
-            sakuraScene->addDynamicPixmap(petals.copy(j*50,i*50,50,50));
-        }
-    }
-    sakuraScene->start();
-    m_screenwriters.append(sakuraScene);
-    qDebug() << sakuraScene;
+    sakuraScene->setPetalSheet(":/petal.png",QSize(50,50));                 //4行3列的花瓣贴图集
+    sakuraScene->setSceneId(SakuraScene);
+    sakuraScene->setPriority(SAKURA_PRIORITY);
+    return sakuraScene;
 }
 
-void Sequencer::firefly()
+Screenwriter *Sequencer::firefly()
 {
     qDebug() << "开始绘制萤火虫";
     ParticleSystem *fireflyParticles = new ParticleSystem(m_scene);     //创建粒子系统
@@ -171,16 +590,21 @@ void Sequencer::firefly()
     fireflyEmitter->setColor(QColor(200,240,50,255),QColor(200,240,50,0));
     fireflyEmitter->setSizeRange(10.0,15.0);
     fireflyEmitter->setLifeTimeRange(150,200);
+    fireflyEmitter->setAlphaCurve({{0.0,0.0},{0.15,1.0},{0.8,1.0},{1.0,0.0}});    //淡入淡出
+    fireflyEmitter->setSizeCurve({{0.0,0.6},{0.2,1.0},{1.0,0.8}});
 
     fireflyParticles->addEmitter(fireflyEmitter);                                   //添加发射器
-    fireflyParticles->addAffector(new TurbulenceAffector(m_scene->sceneRect()));    //添加随机扰动
-
-    fireflyParticles->start();
-    m_screenwriters.append(fireflyParticles);
-    qDebug() << fireflyParticles;
+    auto flow = QSharedPointer<const FlowField>(new FlowField(FlowField::curlNoise(64,16,4)));
+    fireflyParticles->addAffector(new FlowFieldAffector(m_scene->sceneRect(),flow,24.0,1.5,0.05));   //添加流场扰动
+    fireflyParticles->addAffector(new FlockingAffector(m_scene->sceneRect(),60.0,0.05,0.03,0.004,5.0)); //添加群聚行为
+
+    fireflyParticles->setSceneId(FireflyScene);
+    fireflyParticles->setPriority(FIREFLY_PRIORITY);
+    fireflyParticles->setRehearse(true);                                            //出场时萤火虫已在空中
+    return fireflyParticles;
 }
 
-void Sequencer::spiralParticle()
+Screenwriter *Sequencer::spiralParticle()
 {
     qDebug() << "开始绘制粒子环绕";
     ParticleSystem *spiral = new ParticleSystem(m_scene);
@@ -201,6 +625,9 @@ void Sequencer::spiralParticle()
     spiralParticlesEmitter->setSizeRange(5.0,8.0);                                //粒子大小
     spiralParticlesEmitter->setLifeTimeRange(400,450);                              //粒子寿命
     spiralParticlesEmitter->setColor(QColor(38,191,221),QColor(38,191,221,0));          //粒子颜色
+    spiralParticlesEmitter->setColorCurve({{0.0,QColor(38,191,221)},{0.6,QColor(120,140,255)},{1.0,QColor(200,120,255,0)}});
+    spiralParticlesEmitter->setSizeCurve({{0.0,1.0},{0.7,1.0},{1.0,0.3}});        //余烬收缩
+    spiralParticlesEmitter->setBeatSync(m_beatMap,BeatMap::HighMid,0.6);            //发射量随中高频能量起伏
 
     //添加粒子发射器
     spiral->addEmitter(spiralParticlesEmitter);
@@ -209,23 +636,33 @@ void Sequencer::spiralParticle()
     spiral->addAffector(new TurbulenceAffector(QRectF(0,0,m_scene->width(),m_scene->height()/2)));
     spiral->addAffector(new ForceAffector(QRectF(m_scene->width()/2 - 100,m_scene->height()-350,200,100),QVector2D(0,-0.3)));
     spiral->addAffector((new AmplitudeAffector(QRectF(m_scene->sceneRect()),0.007)));
-    //开始
-    spiral->start();
 
-    //加人节目单
-    m_screenwriters.append(spiral);
-    qDebug() << spiral;
+    //上半场的星系漩涡：中心引力井带顺时针旋转，环绕粒子彼此之间也有微弱引力(Barnes–Hut汇总)
+    AttractorAffector *galaxy = new AttractorAffector(QRectF(0,0,m_scene->width(),m_scene->height()/2),0.5,30.0,0.05);
+    galaxy->addSource(QPointF(m_scene->width()/2,m_scene->height()/4),300.0,3.0);
+    galaxy->setParticleSources(spiralParticlesEmitter,0.3);
+    spiral->addAffector(galaxy);
+    spiral->setSceneId(SpiralScene);
+    spiral->setPriority(SPIRAL_PRIORITY);
+    return spiral;
 }
 
-void Sequencer::fireworks()
+Screenwriter *Sequencer::fireworks()
 {
     qDebug() << "开始绘制烟花";
     ParticleSystem *firework = new ParticleSystem(m_scene);
 
+    //拖尾层(代替逐帧生成的溅射粒子)
+    TrailLayer *trail = new TrailLayer(m_scene->sceneRect());
+    trail->setZValue(-0.5);
+    trail->moveToThread(m_scene->thread());                                    //本函数运行在调度线程，图元需归属场景所在线程
+    firework->setTrailLayer(trail);
+
     //创建粒子工厂
-    auto fireworksParticles = [](const ParticleParams& params){
+    auto fireworksParticles = [trail](const ParticleParams& params){
         FireworkParticle *p = new FireworkParticle(params);
         p->setExplodeParams(true,true);
+        p->setTrailLayer(trail);
         p->setFlickerFrequency(10);
         return p;
     };
@@ -237,25 +674,53 @@ void Sequencer::fireworks()
     fireworksParticlesEmitter->setVelocity(QVector2D(0,-1.0),4.0,6.0);
     fireworksParticlesEmitter->setSizeRange(15.0,20.0);
     fireworksParticlesEmitter->setLifeTimeRange(100,120);
+    fireworksParticlesEmitter->setSizeCurve({{0.0,1.0},{1.0,0.5}});               //上升过程中逐渐收缩
+    fireworksParticlesEmitter->setBeatSync(m_beatMap,BeatMap::Bass,0.0,true);       //踩拍发射
+
+    //烟花弹炸开时向四周溅出金色火星(子发射器)
+    Emitter *sparkEmitter = new Emitter(m_scene,[](const ParticleParams& params){return new Particle(params);});
+    QPainterPath ring;
+    ring.addEllipse(QPointF(0,0),10,10);
+    sparkEmitter->setEmissionShape(EmissionShape::fromPath(ring,false,3.0));         //火星从炸点周围的圆环上出发
+    sparkEmitter->setEmitingParams(0,24,0);
+    sparkEmitter->setVelocity(QVector2D(0,-1.0),1.0,2.5);
+    sparkEmitter->setSpread(360);                                                     //全方向
+    sparkEmitter->setColor(QColor(255,220,120),QColor(255,160,60,0));
+    sparkEmitter->setSizeRange(2.0,4.0);
+    sparkEmitter->setLifeTimeRange(30,50);
+    sparkEmitter->setAlphaCurve({{0.0,1.0},{0.6,0.8},{1.0,0.0}});
+    fireworksParticlesEmitter->addSubEmitter(sparkEmitter,Emitter::OnDeath);
 
     firework->addEmitter(fireworksParticlesEmitter);
 
     firework->addAffector(new TurbulenceAffector(m_scene->sceneRect()));
 
-    firework->start();
-    m_screenwriters.append(firework);
-    qDebug() << firework;
+    firework->setSceneId(FireworksScene);
+    firework->setPriority(FIREWORKS_PRIORITY);
+    return firework;
 }
 
-void Sequencer::orchidBubbleFireworks()
+Screenwriter *Sequencer::orchidBubbleFireworks()
 {
     qDebug() << "开始绘制兰花";
     CustomScenery *orchid = new CustomScenery(m_scene);
 
-    orchid->start();
-    m_screenwriters.append(orchid);
-    qDebug() << orchid;
+    //泡影升到画面中央时被心形轮廓留住
+    const QPointF center(m_scene->width()/2, m_scene->height()/2 - 50);
+    auto heart = QSharedPointer<const ShapeField>(new ShapeField(ShapeField::heart(center, 180.0, 60.0, 6.0)));
+    orchid->addAffector(new ShapeContainAffector(m_scene->sceneRect(), heart, 0.15, 30.0));
+
+    orchid->setSceneId(OrchidScene);
+    orchid->setPriority(ORCHID_PRIORITY);
+    return orchid;
+}
 
+void Sequencer::openReadme()
+{
+    if(m_fastForwarding)
+    {
+        return;
+    }
     QString filePath = "./readme.txt";
     QFileInfo fileInfo(filePath);
 
@@ -274,28 +739,27 @@ void Sequencer::orchidBubbleFireworks()
 
 void Sequencer::endOfCurrentScene()
 {
-    if(!m_screenwriters.isEmpty())
-    {
-        m_screenwriters.first()->shouldStop();
-    }
+    m_scheduler->stopOldest();
 }
 
+//平滑过渡时夜色自上而下擦过，否则背景色整体渐变
 void Sequencer::sceneTransition2()
 {
-    setSceneColorGrayGradually(255,0);
+    if(m_smoothTransitions.load(std::memory_order_relaxed))
+    {
+        m_transitions->add(new Wipe(m_scene, QColor(0,0,0), Qt::TopEdge, GRAY_FADE));
+        return;
+    }
+    m_transitions->add(new ColorRamp(m_scene, QColor(255,255,255), QColor(0,0,0), GRAY_FADE));
 }
 
+//平滑过渡时白色自下而上擦过夜空，否则背景色整体渐变
 void Sequencer::sceneTransition3()
 {
-    setSceneColorGrayGradually(0,255);
-}
-
-void Sequencer::setSceneColorGrayGradually(int start, int end)
-{
-    int total = std::abs(start - end);
-    for (int var = 0; var < total + 1; ++var) {
-        int Gray = start + (end - start) * var / total;
-        m_scene->setBackgroundBrush(QColor(Gray,Gray,Gray));
-        QThread::msleep(10);
+    if(m_smoothTransitions.load(std::memory_order_relaxed))
+    {
+        m_transitions->add(new Wipe(m_scene, QColor(255,255,255), Qt::BottomEdge, GRAY_FADE));
+        return;
     }
+    m_transitions->add(new ColorRamp(m_scene, QColor(0,0,0), QColor(255,255,255), GRAY_FADE));
 }
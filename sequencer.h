@@ -2,14 +2,45 @@
 #define SEQUENCER_H
 
 #include <QThread>
-#include <QTimer>
+#include <QMutex>
+#include <QWaitCondition>
 #include <QGraphicsScene>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QSharedPointer>
+#include <atomic>
+
+#define TICK_INTERVAL 20            //模拟步长(毫秒)
+#define REVEAL_FADE 1000            //排练中的场景出场时的淡入时长(毫秒)
+#define CROSS_FADE 3000             //平滑过渡时场景交叉淡入淡出时长(毫秒)
+#define GRAY_FADE 2560              //白景与夜景之间背景色渐变时长(毫秒)
+#define MAX_CATCHUP_TICKS 5         //卡顿后一帧内最多追赶的模拟步数
+#define SNAPSHOT_INTERVAL 5000      //快照间隔(毫秒)
+#define SNAPSHOT_VERSION 4          //快照格式版本
+#define PREWARM_LEAD 3              //场景预热提前量(秒)
+#define TIMELINE_MAX_WAIT 1000      //时间线线程未被唤醒时的最长等待(毫秒)
+
+//场景优先级：后出场的场景优先级更高，交叠时优先保证新场景生成粒子
+#define SAKURA_PRIORITY 10
+#define FIREFLY_PRIORITY 20
+#define SPIRAL_PRIORITY 30
+#define FIREWORKS_PRIORITY 40
+#define ORCHID_PRIORITY 50
+
+class Scheduler;
 class Screenwriter;
+class FrameDriver;
+class ParticleLayer;
+class Transitions;
+class AudioAnalyzer;
+class BeatMap;
+class BeatMapSlot;
 //class GraphicsScene;
 
 struct TimelineEvent {
     int timestamp; // 时间戳（秒）
     std::function<void()> callback; // 回调函数
+    QString name; // 事件名称(同步延迟统计)
 
 };
 
@@ -17,47 +48,106 @@ class Sequencer : public QThread
 {
     Q_OBJECT
 public:
-    explicit Sequencer(QGraphicsScene *scene,QObject *parent = nullptr);
+    //场景编号(用于快照恢复时重建编剧)
+    enum SceneId {
+        SakuraScene,
+        FireflyScene,
+        SpiralScene,
+        FireworksScene,
+        OrchidScene
+    };
+
+    //live为false时不分析音频、不启动帧驱动，由调用者逐步推进(用于基准测试)
+    explicit Sequencer(QGraphicsScene *scene,QObject *parent = nullptr,bool live = true);
     ~Sequencer();
     void setCurrentTimestamp(int timestamp);                                //接收父对象的时间戳，即音乐播放进度
+    void setCurrentPosition(qint64 position);                               //接收音乐播放位置(毫秒)，用于快照计时
+    void seek(qint64 position);                                             //跳转：恢复最近的快照并快进到目标时间(毫秒)
+    FrameDriver *frameDriver() const {return m_frameDriver;}
+    void buildScene(int sceneId);                                           //按场景编号创建编剧并加入节目单
+    void setPrewarmLead(int seconds);                                       //场景预热提前量(秒)，需在时间线启动前设置
+    void step();                                                            //离线推进一个模拟步(含依赖墙钟的动画)
+    void setPipelined(bool pipelined);                                      //粒子光栅化与下一帧模拟重叠(粒子晚一帧显示)
+    void setSmoothTransitions(bool smooth){m_smoothTransitions.store(smooth, std::memory_order_relaxed);} //场景交叉淡入淡出、背景擦除(默认为背景渐变与直接出场)
+    void stopTimeline();                                                    //中断时间线线程并等待其退出
+    void curtain();                                                         //谢幕：所有编剧收场，收场完毕后帧驱动挂起
+    bool isSuspended() const {return m_suspended;}                          //帧驱动是否因空闲而挂起
 
 protected:
     void run() override;                                                    //线程任务
 
 public slots:
-    void onTimerTimeout();
+    void onFrame(qint64 timestamp);                                         //显示帧：按实际经过时间推进固定步长的模拟
+    void onTick();
     void onBackgroundLoading();
     void onBackgroundChanged(qreal start, qreal end, int duration);         //背景改变
+    void wake();                                                            //有新的演出内容：恢复被挂起的帧驱动
 
 private:
-    void addEvent(int timestamp, std::function<void()> callback);           //添加任务事件
+    void addEvent(int timestamp, std::function<void()> callback, const QString &name = QString());  //添加任务事件
+    void buildTimeline();                                                   //建立节目时间线
+    void addCue(int timestamp, int sceneId);                                //添加场景出场事件及其提前的预热事件
+    Screenwriter *createScene(int sceneId);                                 //按场景编号创建编剧(不加入节目单)
+    void prewarm(int sceneId);                                              //预热即将出场的场景
+    void cue(int sceneId);                                                  //场景出场
+    void actOut(bool render);                                               //推进一帧演出
+    qint64 currentPosition() const;                                         //估算当前音乐位置(毫秒)
+    bool isIdle() const;                                                    //没有编剧与过渡，不需要出帧
+
+    //快照
+    QByteArray saveSnapshot() const;
+    void restoreSnapshot(const QByteArray &snapshot);
 
     //场景任务
     void backgroundFadein();
     void backgroundFadeout();
-    void sakura();                      //场景一：樱树
-    void firefly();                     //场景二：萤火虫
-    void spiralParticle();              //场景三：粒子环绕
-    void fireworks();                   //场景四：烟花
-    void orchidBubbleFireworks();       //场景五：兰花、泡影
+    Screenwriter *sakura();             //场景一：樱树
+    Screenwriter *firefly();            //场景二：萤火虫
+    Screenwriter *spiralParticle();     //场景三：粒子环绕
+    Screenwriter *fireworks();          //场景四：烟花
+    Screenwriter *orchidBubbleFireworks(); //场景五：兰花、泡影
+
+    void openReadme();                  //打开留言
 
     void endOfCurrentScene();           //每场演出结束
     void sceneTransition2();            //场景过渡（白切黑）
     void sceneTransition3();            //场景过渡（黑切白）
 
-    void setSceneColorGrayGradually(int start,int end);
-
 signals:
     void backgroundLoading();
     void backgroundChanged(qreal start, qreal end, int duration);
+    void seeked(qint64 position);                                           //跳转完成，需同步音乐播放位置
 
 private:
-    QTimer * m_timer;
+    FrameDriver *m_frameDriver;
+    qint64 m_lastFrame = -1;                                                //上一显示帧时间戳(纳秒)
+    qint64 m_accumulator = 0;                                               //尚未模拟的时间(纳秒)
     QGraphicsScene *m_scene;
     QList<TimelineEvent> m_events;
-    int m_timestamp;
+    int m_nextEvent = 0;                                                    //下一个待执行事件
+    int m_timestamp = 0;
+    mutable QMutex m_timelineMutex;                                         //保护m_timestamp与音乐位置，配合m_timelineChanged唤醒时间线线程
+    QMutex m_eventMutex;                                                    //事件执行期间持有(先于m_timelineMutex加锁)，快照不会落在事件中途
+    QWaitCondition m_timelineChanged;                                       //音乐进度推进或请求中断
+    std::atomic<bool> m_smoothTransitions{false};                           //由GUI线程设置，时间线事件执行时读取
+    bool m_suspended = false;                                               //帧驱动因空闲而挂起
+
+    qint64 m_position = 0;                                                  //最近一次上报的音乐位置
+    QElapsedTimer m_positionClock;                                          //距上次上报经过的时间
+    QMap<qint64, QByteArray> m_snapshots;                                   //音乐位置 -> 压缩快照
+    qint64 m_nextSnapshot = 0;
+    bool m_resuming = false;                                                //跳转后继续执行时间线
+    bool m_fastForwarding = false;                                          //快进中(不渲染、不等待)
+
+    AudioAnalyzer *m_analyzer;                                              //音频分析(首次运行时后台分析并缓存)
+    QSharedPointer<BeatMapSlot> m_beatMap;                                  //节拍与能量图(分析完成后写入，各线程共享)
+
+    int m_prewarmLead;                                                      //场景预热提前量(秒)
+    QMap<int, Screenwriter*> m_prewarmed;                                   //已预热、尚未出场的编剧(场景编号 -> 编剧)
 
-    QList<Screenwriter*> m_screenwriters;
+    Transitions *m_transitions;                                             //过渡：由显示帧推进，时间线线程只负责添加
+    Scheduler *m_scheduler;                                                 //节目单：同时推进所有正在演出的编剧
+    ParticleLayer *m_particleLayer;                                         //粒子层：分块并行光栅化所有粒子系统的粒子
     //bool m_showing = false;
 
 };
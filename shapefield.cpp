@@ -0,0 +1,200 @@
+#include "shapefield.h"
+#include <QImage>
+#include <QPainter>
+#include <QtMath>
+
+namespace {
+
+//8SSEDT向量传播距离变换：返回每个格子到最近种子格子的欧氏距离(格子单位)
+QVector<float> distanceToSeeds(const QVector<bool> &seeds, int cols, int rows)
+{
+    const int far = 1 << 14;
+    QVector<QPoint> nearest(cols * rows);
+    for (int i = 0; i < nearest.count(); ++i) {
+        nearest[i] = seeds.at(i) ? QPoint(0,0) : QPoint(far,far);
+    }
+
+    auto lengthSquared = [](const QPoint &p){return qint64(p.x()) * p.x() + qint64(p.y()) * p.y();};
+    auto compare = [&](int x, int y, int ox, int oy) {
+        const int nx = x + ox;
+        const int ny = y + oy;
+        if(nx < 0 || ny < 0 || nx >= cols || ny >= rows)
+        {
+            return;
+        }
+        const QPoint candidate = nearest.at(ny * cols + nx) + QPoint(ox,oy);
+        QPoint &current = nearest[y * cols + x];
+        if(lengthSquared(candidate) < lengthSquared(current))
+        {
+            current = candidate;
+        }
+    };
+
+    //正向扫描
+    for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < cols; ++x) {
+            compare(x,y,-1,0);
+            compare(x,y,0,-1);
+            compare(x,y,-1,-1);
+            compare(x,y,1,-1);
+        }
+        for (int x = cols - 1; x >= 0; --x) {
+            compare(x,y,1,0);
+        }
+    }
+
+    //反向扫描
+    for (int y = rows - 1; y >= 0; --y) {
+        for (int x = cols - 1; x >= 0; --x) {
+            compare(x,y,1,0);
+            compare(x,y,0,1);
+            compare(x,y,-1,1);
+            compare(x,y,1,1);
+        }
+        for (int x = 0; x < cols; ++x) {
+            compare(x,y,-1,0);
+        }
+    }
+
+    QVector<float> distances(cols * rows);
+    for (int i = 0; i < nearest.count(); ++i) {
+        distances[i] = std::sqrt(float(lengthSquared(nearest.at(i))));
+    }
+    return distances;
+}
+
+}
+
+ShapeField ShapeField::fromImplicit(const ImplicitFunction &function, const QRectF &bounds, qreal cellSize)
+{
+    ShapeField field;
+    field.m_cellSize = cellSize;
+    field.m_cols = std::max(2, qCeil(bounds.width() / cellSize));
+    field.m_rows = std::max(2, qCeil(bounds.height() / cellSize));
+    field.m_bounds = QRectF(bounds.topLeft(), QSizeF(field.m_cols * cellSize, field.m_rows * cellSize));
+
+    //在每个格子中心求值
+    QVector<bool> inside(field.m_cols * field.m_rows);
+    for (int y = 0; y < field.m_rows; ++y) {
+        for (int x = 0; x < field.m_cols; ++x) {
+            const QPointF center = field.m_bounds.topLeft() + QPointF((x + 0.5) * cellSize, (y + 0.5) * cellSize);
+            inside[y * field.m_cols + x] = function(center) <= 0;
+        }
+    }
+    field.bake(inside);
+    return field;
+}
+
+ShapeField ShapeField::fromPath(const QPainterPath &path, qreal margin, qreal cellSize)
+{
+    ShapeField field;
+    const QRectF bounds = path.boundingRect().adjusted(-margin,-margin,margin,margin);
+    field.m_cellSize = cellSize;
+    field.m_cols = std::max(2, qCeil(bounds.width() / cellSize));
+    field.m_rows = std::max(2, qCeil(bounds.height() / cellSize));
+    field.m_bounds = QRectF(bounds.topLeft(), QSizeF(field.m_cols * cellSize, field.m_rows * cellSize));
+
+    //以格子为像素栅格化路径(不抗锯齿)，比逐点调用QPainterPath::contains快得多
+    QImage mask(field.m_cols, field.m_rows, QImage::Format_Grayscale8);
+    mask.fill(0);
+    QPainter painter(&mask);
+    painter.scale(1.0 / cellSize, 1.0 / cellSize);
+    painter.translate(-field.m_bounds.topLeft());
+    painter.fillPath(path, Qt::white);
+    painter.end();
+
+    QVector<bool> inside(field.m_cols * field.m_rows);
+    for (int y = 0; y < field.m_rows; ++y) {
+        const uchar *line = mask.constScanLine(y);
+        for (int x = 0; x < field.m_cols; ++x) {
+            inside[y * field.m_cols + x] = line[x] > 127;
+        }
+    }
+    field.bake(inside);
+    return field;
+}
+
+ShapeField ShapeField::heart(const QPointF &center, qreal scale, qreal margin, qreal cellSize)
+{
+    auto heartFunction = [center, scale](const QPointF &pos) {
+        const qreal x = (pos.x() - center.x()) / scale;
+        const qreal y = (center.y() - pos.y()) / scale;       //场景y轴向下，取反使心尖朝下
+        const qreal x2 = x * x;
+        const qreal y2 = y * y;
+        const qreal temp = x2 + y2 - 1.0;
+        return temp * temp * temp - x2 * y2 * y;
+    };
+    const qreal extent = 1.5 * scale + margin;
+    return fromImplicit(heartFunction, QRectF(center.x() - extent, center.y() - extent, 2 * extent, 2 * extent), cellSize);
+}
+
+bool ShapeField::sample(const QPointF &pos, qreal *distance, QVector2D *gradient) const
+{
+    if(isNull())
+    {
+        return false;
+    }
+    const qreal fx = (pos.x() - m_bounds.left()) / m_cellSize - 0.5;
+    const qreal fy = (pos.y() - m_bounds.top()) / m_cellSize - 0.5;
+    if(fx < 0 || fy < 0 || fx > m_cols - 1 || fy > m_rows - 1)
+    {
+        return false;
+    }
+
+    //双线性插值
+    const int x0 = int(fx);
+    const int y0 = int(fy);
+    const int x1 = std::min(x0 + 1, m_cols - 1);
+    const int y1 = std::min(y0 + 1, m_rows - 1);
+    const float tx = float(fx - x0);
+    const float ty = float(fy - y0);
+    const Cell &c00 = m_cells.at(y0 * m_cols + x0);
+    const Cell &c10 = m_cells.at(y0 * m_cols + x1);
+    const Cell &c01 = m_cells.at(y1 * m_cols + x0);
+    const Cell &c11 = m_cells.at(y1 * m_cols + x1);
+    auto lerp2 = [tx, ty](float v00, float v10, float v01, float v11) {
+        const float top = v00 + (v10 - v00) * tx;
+        const float bottom = v01 + (v11 - v01) * tx;
+        return top + (bottom - top) * ty;
+    };
+
+    *distance = lerp2(c00.distance, c10.distance, c01.distance, c11.distance);
+    if(gradient)
+    {
+        *gradient = QVector2D(lerp2(c00.gx, c10.gx, c01.gx, c11.gx), lerp2(c00.gy, c10.gy, c01.gy, c11.gy));
+    }
+    return true;
+}
+
+void ShapeField::bake(const QVector<bool> &inside)
+{
+    QVector<bool> outside(inside.count());
+    for (int i = 0; i < inside.count(); ++i) {
+        outside[i] = !inside.at(i);
+    }
+    const QVector<float> toInside = distanceToSeeds(inside, m_cols, m_rows);
+    const QVector<float> toOutside = distanceToSeeds(outside, m_cols, m_rows);
+
+    //有向距离：边界位于内外格子中心之间，故减去半个格子
+    m_cells.resize(m_cols * m_rows);
+    for (int i = 0; i < m_cells.count(); ++i) {
+        const float d = inside.at(i) ? -(toOutside.at(i) - 0.5f) : (toInside.at(i) - 0.5f);
+        m_cells[i].distance = d * float(m_cellSize);
+    }
+
+    //中心差分求梯度并归一化
+    for (int y = 0; y < m_rows; ++y) {
+        for (int x = 0; x < m_cols; ++x) {
+            const int left = std::max(x - 1, 0);
+            const int right = std::min(x + 1, m_cols - 1);
+            const int up = std::max(y - 1, 0);
+            const int down = std::min(y + 1, m_rows - 1);
+            const float gx = m_cells.at(y * m_cols + right).distance - m_cells.at(y * m_cols + left).distance;
+            const float gy = m_cells.at(down * m_cols + x).distance - m_cells.at(up * m_cols + x).distance;
+            const float length = std::sqrt(gx * gx + gy * gy);
+            Cell &cell = m_cells[y * m_cols + x];
+            cell.gx = length > 1e-6f ? gx / length : 0.0f;
+            cell.gy = length > 1e-6f ? gy / length : 0.0f;
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef SHAPEFIELD_H
+#define SHAPEFIELD_H
+
+#include <QPainterPath>
+#include <QRectF>
+#include <QVector2D>
+#include <QVector>
+#include <functional>
+
+//形状距离场
+//将隐式方程或QPainterPath预先烘焙为有向距离网格(形状内为负，形状外为正，单位为场景像素)，
+//并同时保存归一化梯度(指向形状外侧)，运行时只需一次双线性采样
+class ShapeField
+{
+public:
+    using ImplicitFunction = std::function<qreal(const QPointF&)>;     //隐式方程，f(p) <= 0 表示点在形状内
+
+    ShapeField() = default;
+
+    static ShapeField fromImplicit(const ImplicitFunction &function, const QRectF &bounds, qreal cellSize = 4.0);
+    static ShapeField fromPath(const QPainterPath &path, qreal margin, qreal cellSize = 4.0);
+    static ShapeField heart(const QPointF &center, qreal scale, qreal margin, qreal cellSize = 4.0);   //心形：(x² + y² - 1)³ - x²y³ <= 0
+
+    bool isNull() const {return m_cols == 0;}
+    QRectF bounds() const {return m_bounds;}
+
+    //采样距离与梯度，点在场范围外时返回false
+    bool sample(const QPointF &pos, qreal *distance, QVector2D *gradient = nullptr) const;
+
+private:
+    void bake(const QVector<bool> &inside);
+
+    QRectF m_bounds;
+    qreal m_cellSize = 1.0;
+    int m_cols = 0;
+    int m_rows = 0;
+
+    struct Cell
+    {
+        float distance;     //有向距离
+        float gx;           //梯度x分量
+        float gy;           //梯度y分量
+    };
+    QVector<Cell> m_cells;
+};
+
+#endif // SHAPEFIELD_H
@@ -0,0 +1,162 @@
+#include "showstats.h"
+#include "screenwriter.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTimer>
+
+ShowStats::ShowStats(QObject *parent)
+    : QObject(parent)
+{
+}
+
+ShowStats *ShowStats::global()
+{
+    static ShowStats stats;
+    return &stats;
+}
+
+void ShowStats::registerSystem(Screenwriter *screenwriter)
+{
+    QMutexLocker locker(&m_mutex);
+    m_systems.append(screenwriter);
+}
+
+void ShowStats::unregisterSystem(Screenwriter *screenwriter)
+{
+    QMutexLocker locker(&m_mutex);
+    m_systems.removeAll(screenwriter);
+}
+
+void ShowStats::spawned(Screenwriter *owner, Spawn spawn, int count)
+{
+    global()->countSpawns(count);
+    if(!owner)
+    {
+        return;
+    }
+    System &stats = owner->stats();
+    switch (spawn) {
+    case Emitted:
+        stats.spawned.fetch_add(count, std::memory_order_relaxed);
+        break;
+    case Splashed:
+        stats.splashed.fetch_add(count, std::memory_order_relaxed);
+        break;
+    case Exploded:
+        stats.exploded.fetch_add(count, std::memory_order_relaxed);
+        break;
+    }
+}
+
+void ShowStats::died(Screenwriter *owner, int count)
+{
+    if(owner)
+    {
+        owner->stats().deaths.fetch_add(count, std::memory_order_relaxed);
+    }
+}
+
+void ShowStats::tickStarted()
+{
+    m_ticks++;
+    m_lastTickSpawns = m_tickSpawns.exchange(0, std::memory_order_relaxed);
+}
+
+void ShowStats::frameStarted()
+{
+    m_frames++;
+    m_lastPaintCalls = m_paintCalls.exchange(0, std::memory_order_relaxed);
+    m_lastRasterized = m_rasterized.exchange(0, std::memory_order_relaxed);
+}
+
+qint64 ShowStats::liveCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    qint64 count = 0;
+    for (Screenwriter *screenwriter : m_systems) {
+        count += screenwriter->stats().live.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+QJsonObject ShowStats::toJson() const
+{
+    QJsonObject bytes;
+    bytes["particleSprites"] = this->bytes(ParticleSprites);
+    bytes["itemPixmaps"] = this->bytes(ItemPixmaps);
+    bytes["orchidTracks"] = this->bytes(OrchidTracks);
+    bytes["layerImages"] = this->bytes(LayerImages);
+
+    QJsonArray systems;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (Screenwriter *screenwriter : m_systems) {
+            const System &stats = screenwriter->stats();
+            QJsonObject system;
+            system["scene"] = screenwriter->sceneId();
+            system["type"] = screenwriter->metaObject()->className();
+            system["live"] = stats.live.load(std::memory_order_relaxed);
+            system["spawned"] = stats.spawned.load(std::memory_order_relaxed);
+            system["splashed"] = stats.splashed.load(std::memory_order_relaxed);
+            system["exploded"] = stats.exploded.load(std::memory_order_relaxed);
+            system["deaths"] = stats.deaths.load(std::memory_order_relaxed);
+            systems.append(system);
+        }
+    }
+
+    QJsonObject json;
+    json["ticks"] = m_ticks;
+    json["frames"] = m_frames;
+    json["missedFrames"] = m_missedFrames.load(std::memory_order_relaxed);
+    json["spawnsLastTick"] = m_lastTickSpawns;
+    json["paintCallsLastFrame"] = m_lastPaintCalls;
+    json["rasterizedLastFrame"] = m_lastRasterized;
+    json["bytes"] = bytes;
+    json["systems"] = systems;
+    return json;
+}
+
+void ShowStats::startDump(const QString &fileName, int interval)
+{
+    m_dumpFile = fileName;
+    if(!m_dumpTimer)
+    {
+        m_dumpTimer = new QTimer(this);
+        connect(m_dumpTimer,&QTimer::timeout,this,&ShowStats::dump);
+        //退出前写入最后一次统计，定时器不能活过应用对象
+        connect(qApp,&QCoreApplication::aboutToQuit,this,[this]() {
+            dump();
+            delete m_dumpTimer;
+            m_dumpTimer = nullptr;
+        });
+    }
+    m_dumpTimer->start(interval);
+}
+
+void ShowStats::stopDump()
+{
+    if(m_dumpTimer)
+    {
+        m_dumpTimer->stop();
+    }
+}
+
+void ShowStats::dump()
+{
+    QFile file(m_dumpFile);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qDebug() << "无法写入统计文件" << m_dumpFile;
+        stopDump();
+        return;
+    }
+    QJsonObject json = toJson();
+    json["time"] = QDateTime::currentMSecsSinceEpoch();
+    file.write(QJsonDocument(json).toJson(QJsonDocument::Compact));
+    file.write("\n");
+}
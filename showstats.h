@@ -0,0 +1,91 @@
+#ifndef SHOWSTATS_H
+#define SHOWSTATS_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QList>
+#include <QMutex>
+#include <atomic>
+
+class QTimer;
+class Screenwriter;
+
+//演出统计：各编剧的存活/生成/死亡粒子数，按类别的内存占用，每个模拟步的生成数与每个显示帧的绘制调用数
+//计数器都是无锁原子变量(relaxed)，常开的代价只是几次整数加法；查询与转储在GUI线程进行
+class ShowStats : public QObject
+{
+    Q_OBJECT
+public:
+    enum Category {
+        ParticleSprites,        //按尺寸共享的粒子贴图
+        ItemPixmaps,            //背景、花瓣、按钮等图片(共享的图片数据会重复计入)
+        OrchidTracks,           //兰花轨迹
+        LayerImages,            //拖尾层、粒子层、图层缓存、渲染缓冲
+        CategoryCount
+    };
+
+    enum Spawn {
+        Emitted,                //由发射器或编剧生成
+        Splashed,               //溅射生成
+        Exploded                //爆炸生成
+    };
+
+    //每个编剧的计数器，由编剧持有
+    struct System
+    {
+        std::atomic<qint64> live{0};
+        std::atomic<qint64> spawned{0};
+        std::atomic<qint64> splashed{0};
+        std::atomic<qint64> exploded{0};
+        std::atomic<qint64> deaths{0};
+    };
+
+    static ShowStats *global();
+
+    void registerSystem(Screenwriter *screenwriter);
+    void unregisterSystem(Screenwriter *screenwriter);
+
+    static void spawned(Screenwriter *owner, Spawn spawn, int count = 1);
+    static void died(Screenwriter *owner, int count = 1);
+    void addBytes(Category category, qint64 bytes){m_bytes[category].fetch_add(bytes, std::memory_order_relaxed);}
+    void countSpawns(int count = 1){m_tickSpawns.fetch_add(count, std::memory_order_relaxed);}
+    void paintCall(){m_paintCalls.fetch_add(1, std::memory_order_relaxed);}
+    void rasterized(int count){m_rasterized.fetch_add(count, std::memory_order_relaxed);}
+    void framesMissed(int count){m_missedFrames.fetch_add(count, std::memory_order_relaxed);}
+
+    void tickStarted();                         //每个模拟步开始时调用
+    void frameStarted();                        //每个显示帧开始时调用
+
+    qint64 bytes(Category category) const {return m_bytes[category].load(std::memory_order_relaxed);}
+    qint64 spawnsLastTick() const {return m_lastTickSpawns;}     //上一模拟步新生成的元素数
+    qint64 paintCallsLastFrame() const {return m_lastPaintCalls;}
+    qint64 liveCount() const;                   //所有编剧的存活元素数之和(粒子、花瓣、兰花等)
+    QJsonObject toJson() const;
+
+    //每隔interval毫秒向fileName追加一行JSON
+    void startDump(const QString &fileName, int interval);
+    void stopDump();
+
+private:
+    explicit ShowStats(QObject *parent = nullptr);
+    void dump();
+
+    mutable QMutex m_mutex;
+    QList<Screenwriter*> m_systems;
+
+    std::atomic<qint64> m_bytes[CategoryCount] = {};
+    std::atomic<qint64> m_tickSpawns{0};
+    std::atomic<qint64> m_paintCalls{0};
+    std::atomic<qint64> m_rasterized{0};
+    std::atomic<qint64> m_missedFrames{0};
+    qint64 m_ticks = 0;
+    qint64 m_frames = 0;
+    qint64 m_lastTickSpawns = 0;
+    qint64 m_lastPaintCalls = 0;
+    qint64 m_lastRasterized = 0;
+
+    QTimer *m_dumpTimer = nullptr;
+    QString m_dumpFile;
+};
+
+#endif // SHOWSTATS_H
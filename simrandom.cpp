@@ -0,0 +1,31 @@
+#include "simrandom.h"
+
+SimRandom *SimRandom::global()
+{
+    static SimRandom generator;
+    return &generator;
+}
+
+void SimRandom::seed(quint64 seed)
+{
+    m_state = 0;
+    generate();
+    m_state += seed;
+    generate();
+}
+
+quint32 SimRandom::generate()
+{
+    const quint64 old = m_state;
+    m_state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+    const quint32 xorshifted = quint32(((old >> 18u) ^ old) >> 27u);
+    const quint32 rot = quint32(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+double SimRandom::generateDouble()
+{
+    const quint64 high = generate();
+    const quint64 low = generate();
+    return ((high << 21) ^ low) * (1.0 / 9007199254740992.0);
+}
@@ -0,0 +1,33 @@
+#ifndef SIMRANDOM_H
+#define SIMRANDOM_H
+
+#include <QtGlobal>
+#include <algorithm>
+
+//模拟用随机数发生器(PCG32)
+//接口与QRandomGenerator::bounded()保持一致，状态只有64位，可保存/恢复，保证快照回放与定种子测试可复现
+//只应在GUI线程(模拟线程)中使用
+class SimRandom
+{
+public:
+    explicit SimRandom(quint64 seed = 0x853c49e6748fea9bULL){this->seed(seed);}
+
+    static SimRandom *global();
+
+    void seed(quint64 seed);
+    quint64 state() const {return m_state;}
+    void setState(quint64 state){m_state = state;}
+
+    quint32 generate();
+    double generateDouble();                                    //[0,1)
+
+    double bounded(double highest){return generateDouble() * highest;}
+    int bounded(int highest){return int((quint64(generate()) * quint32(std::max(highest, 0))) >> 32);}
+    qint64 bounded(qint64 highest){return qint64(generateDouble() * std::max<qint64>(highest, 0));}
+    int bounded(int lowest, int highest){return lowest + bounded(highest - lowest);}
+
+private:
+    quint64 m_state;
+};
+
+#endif // SIMRANDOM_H
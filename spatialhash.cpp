@@ -0,0 +1,30 @@
+#include "spatialhash.h"
+
+SpatialHash::SpatialHash(qreal cellSize, int bucketCount)
+    : m_cellSize(cellSize)
+    , m_bucketCount(int(qNextPowerOfTwo(quint32(std::max(bucketCount, 2) - 1))))
+{
+    m_bucketStart.fill(0, m_bucketCount + 1);
+}
+
+void SpatialHash::build(const QVector<Entry> &entries)
+{
+    //计数排序：统计每个桶的条目数，前缀和得到起始下标，再按桶放置
+    QVector<int> buckets(entries.count());
+    m_bucketStart.fill(0, m_bucketCount + 1);
+    for (int i = 0; i < entries.count(); ++i) {
+        const int cx = qFloor(entries.at(i).position.x() / m_cellSize);
+        const int cy = qFloor(entries.at(i).position.y() / m_cellSize);
+        buckets[i] = bucketOf(cx, cy);
+        m_bucketStart[buckets.at(i) + 1]++;
+    }
+    for (int b = 0; b < m_bucketCount; ++b) {
+        m_bucketStart[b + 1] += m_bucketStart.at(b);
+    }
+
+    QVector<int> cursor(m_bucketStart.constBegin(), m_bucketStart.constEnd() - 1);
+    m_entries.resize(entries.count());
+    for (int i = 0; i < entries.count(); ++i) {
+        m_entries[cursor[buckets.at(i)]++] = entries.at(i);
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef SPATIALHASH_H
+#define SPATIALHASH_H
+
+#include <QPointF>
+#include <QVector2D>
+#include <QVector>
+#include <QVarLengthArray>
+#include <QtMath>
+
+//空间哈希
+//每帧重建一次：按格子计数排序存放到连续数组，邻域查询只访问半径覆盖的格子，整体代价O(n)
+class SpatialHash
+{
+public:
+    struct Entry
+    {
+        QPointF position;
+        QVector2D velocity;
+        const void *key;        //所属对象(查询时用于排除自身)
+    };
+
+    explicit SpatialHash(qreal cellSize = 40.0, int bucketCount = 4096);
+
+    void setCellSize(qreal cellSize){m_cellSize = cellSize;}
+    void build(const QVector<Entry> &entries);
+    int count() const {return m_entries.count();}
+
+    //遍历半径内的所有条目，func返回false时提前结束
+    template<typename Func>
+    void query(const QPointF &center, qreal radius, Func func) const;
+
+private:
+    int bucketOf(int cx, int cy) const
+    {
+        const quint32 h = quint32(cx) * 73856093u ^ quint32(cy) * 19349663u;
+        return int(h & quint32(m_bucketCount - 1));
+    }
+
+    qreal m_cellSize;
+    int m_bucketCount;
+    QVector<int> m_bucketStart;     //每个桶在m_entries中的起始下标，长度为桶数+1
+    QVector<Entry> m_entries;       //按桶排序的条目
+};
+
+template<typename Func>
+void SpatialHash::query(const QPointF &center, qreal radius, Func func) const
+{
+    if(m_entries.isEmpty())
+    {
+        return;
+    }
+    const int minX = qFloor((center.x() - radius) / m_cellSize);
+    const int maxX = qFloor((center.x() + radius) / m_cellSize);
+    const int minY = qFloor((center.y() - radius) / m_cellSize);
+    const int maxY = qFloor((center.y() + radius) / m_cellSize);
+    const qreal radius2 = radius * radius;
+
+    //不同格子可能哈希到同一个桶，记录已访问的桶避免重复遍历(常见的4×4格以内不分配堆内存，半径更大时自动扩容)
+    QVarLengthArray<int, 16> visited;
+    for (int cy = minY; cy <= maxY; ++cy) {
+        for (int cx = minX; cx <= maxX; ++cx) {
+            const int bucket = bucketOf(cx, cy);
+            if(visited.contains(bucket))
+            {
+                continue;
+            }
+            visited.append(bucket);
+            for (int i = m_bucketStart.at(bucket); i < m_bucketStart.at(bucket + 1); ++i) {
+                const Entry &entry = m_entries.at(i);
+                const qreal dx = entry.position.x() - center.x();
+                const qreal dy = entry.position.y() - center.y();
+                if(dx * dx + dy * dy <= radius2 && !func(entry))
+                {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+#endif // SPATIALHASH_H
@@ -0,0 +1,326 @@
+#include "splat.h"
+#include <QImage>
+#include <QtMath>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPLAT_SSE41
+#include <immintrin.h>
+#endif
+
+namespace {
+
+//一行内的圆点参数(像素坐标)
+struct Row
+{
+    float cx;
+    float dy2;              //本行像素中心到圆心的纵向距离平方
+    float radius;
+    float inverseRadius;
+    float falloff;
+    QRgb color;             //预乘
+    Splat::Mode mode;
+};
+
+//覆盖率(边缘抗锯齿)乘以径向衰减，量化到[0,256]
+inline int weightAt(const Row &row, int x)
+{
+    const float fx = float(x) + 0.5f - row.cx;
+    const float d = std::sqrt(fx * fx + row.dy2);
+    const float coverage = std::min(std::max(row.radius + 0.5f - d, 0.0f), 1.0f);
+    const float intensity = 1.0f - row.falloff * std::min(d * row.inverseRadius, 1.0f);
+    return int(coverage * intensity * 256.0f);
+}
+
+inline int overlayChannel(int s, int sa, int d, int da)
+{
+    const int value = 2 * d < da
+        ? 2 * s * d + s * (255 - da) + d * (255 - sa)
+        : sa * da - 2 * (da - d) * (sa - s) + s * (255 - da) + d * (255 - sa);
+    return qBound(0, value / 255, 255);
+}
+
+//与SSE路径逐位一致的标量混合
+inline quint32 blendPixel(quint32 dst, QRgb color, int weight, Splat::Mode mode)
+{
+    const int sa = (qAlpha(color) * weight) >> 8;
+    const int sr = (qRed(color) * weight) >> 8;
+    const int sg = (qGreen(color) * weight) >> 8;
+    const int sb = (qBlue(color) * weight) >> 8;
+    const int da = qAlpha(dst);
+    const int dr = qRed(dst);
+    const int dg = qGreen(dst);
+    const int db = qBlue(dst);
+    switch (mode) {
+    case Splat::Additive:
+        return qRgba(std::min(dr + sr, 255), std::min(dg + sg, 255), std::min(db + sb, 255), std::min(da + sa, 255));
+    case Splat::Overlay:
+        return qRgba(overlayChannel(sr, sa, dr, da), overlayChannel(sg, sa, dg, da), overlayChannel(sb, sa, db, da),
+                     sa + da - sa * da / 255);
+    case Splat::Alpha:
+    default:
+    {
+        const int inverse = 256 - sa;
+        return qRgba(sr + ((dr * inverse) >> 8), sg + ((dg * inverse) >> 8), sb + ((db * inverse) >> 8), sa + ((da * inverse) >> 8));
+    }
+    }
+}
+
+void blendRowScalar(quint32 *line, int from, int to, const Row &row)
+{
+    for (int x = from; x < to; ++x) {
+        const int weight = weightAt(row, x);
+        if(weight > 0)
+        {
+            line[x] = blendPixel(line[x], row.color, weight, row.mode);
+        }
+    }
+}
+
+#ifdef SPLAT_SSE41
+//每次4个像素：浮点计算权重，展开为16位通道做乘加，与标量路径使用相同的整数近似
+__attribute__((target("sse4.1")))
+void blendRowSse41(quint32 *line, int from, int to, const Row &row)
+{
+    if(row.mode == Splat::Overlay)
+    {
+        blendRowScalar(line, from, to, row);
+        return;
+    }
+    const __m128 cx = _mm_set1_ps(row.cx);
+    const __m128 dy2 = _mm_set1_ps(row.dy2);
+    const __m128 edge = _mm_set1_ps(row.radius + 0.5f);
+    const __m128 inverseRadius = _mm_set1_ps(row.inverseRadius);
+    const __m128 falloff = _mm_set1_ps(row.falloff);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(256.0f);
+    const __m128i color16 = _mm_cvtepu8_epi16(_mm_set1_epi32(int(row.color)));
+    const __m128i full = _mm_set1_epi16(256);
+    const __m128i offsets = _mm_setr_epi32(0, 1, 2, 3);
+
+    int x = from;
+    for (; x + 4 <= to; x += 4) {
+        const __m128 px = _mm_add_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x), offsets)), half);
+        const __m128 fx = _mm_sub_ps(px, cx);
+        const __m128 d = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(fx, fx), dy2));
+        const __m128 coverage = _mm_min_ps(_mm_max_ps(_mm_sub_ps(edge, d), zero), one);
+        const __m128 intensity = _mm_sub_ps(one, _mm_mul_ps(falloff, _mm_min_ps(_mm_mul_ps(d, inverseRadius), one)));
+        const __m128i w32 = _mm_cvttps_epi32(_mm_mul_ps(_mm_mul_ps(coverage, intensity), scale));
+        if(_mm_testz_si128(w32, w32))
+        {
+            continue;
+        }
+
+        //权重展开为每像素4个通道：w0 w0 w0 w0 w1 w1 w1 w1 / w2 ... w3
+        __m128i w16 = _mm_packs_epi32(w32, w32);
+        w16 = _mm_unpacklo_epi16(w16, w16);
+        const __m128i wLow = _mm_unpacklo_epi32(w16, w16);
+        const __m128i wHigh = _mm_unpackhi_epi32(w16, w16);
+        const __m128i sLow = _mm_srli_epi16(_mm_mullo_epi16(color16, wLow), 8);
+        const __m128i sHigh = _mm_srli_epi16(_mm_mullo_epi16(color16, wHigh), 8);
+
+        __m128i *address = reinterpret_cast<__m128i*>(line + x);
+        const __m128i dst = _mm_loadu_si128(address);
+        __m128i out;
+        if(row.mode == Splat::Additive)
+        {
+            out = _mm_adds_epu8(dst, _mm_packus_epi16(sLow, sHigh));
+        }
+        else
+        {
+            const __m128i dLow = _mm_cvtepu8_epi16(dst);
+            const __m128i dHigh = _mm_cvtepu8_epi16(_mm_srli_si128(dst, 8));
+            const __m128i aLow = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sLow, 0xFF), 0xFF);
+            const __m128i aHigh = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sHigh, 0xFF), 0xFF);
+            const __m128i oLow = _mm_add_epi16(sLow, _mm_srli_epi16(_mm_mullo_epi16(dLow, _mm_sub_epi16(full, aLow)), 8));
+            const __m128i oHigh = _mm_add_epi16(sHigh, _mm_srli_epi16(_mm_mullo_epi16(dHigh, _mm_sub_epi16(full, aHigh)), 8));
+            out = _mm_packus_epi16(oLow, oHigh);
+        }
+        _mm_storeu_si128(address, out);
+    }
+    blendRowScalar(line, x, to, row);
+}
+
+//每次8个像素：与SSE4.1路径相同的运算，权重展开时跨128位通道重排，剩余像素交给SSE4.1路径
+__attribute__((target("avx2")))
+void blendRowAvx2(quint32 *line, int from, int to, const Row &row)
+{
+    if(row.mode == Splat::Overlay)
+    {
+        blendRowScalar(line, from, to, row);
+        return;
+    }
+    const __m256 cx = _mm256_set1_ps(row.cx);
+    const __m256 dy2 = _mm256_set1_ps(row.dy2);
+    const __m256 edge = _mm256_set1_ps(row.radius + 0.5f);
+    const __m256 inverseRadius = _mm256_set1_ps(row.inverseRadius);
+    const __m256 falloff = _mm256_set1_ps(row.falloff);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 scale = _mm256_set1_ps(256.0f);
+    const __m256i color16 = _mm256_cvtepu8_epi16(_mm_set1_epi32(int(row.color)));
+    const __m256i full = _mm256_set1_epi16(256);
+    const __m256i offsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i lowPixels = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const __m256i highPixels = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+
+    int x = from;
+    for (; x + 8 <= to; x += 8) {
+        const __m256 px = _mm256_add_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x), offsets)), half);
+        const __m256 fx = _mm256_sub_ps(px, cx);
+        const __m256 d = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(fx, fx), dy2));
+        const __m256 coverage = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(edge, d), zero), one);
+        const __m256 intensity = _mm256_sub_ps(one, _mm256_mul_ps(falloff, _mm256_min_ps(_mm256_mul_ps(d, inverseRadius), one)));
+        const __m256i w32 = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_mul_ps(coverage, intensity), scale));
+        if(_mm256_testz_si256(w32, w32))
+        {
+            continue;
+        }
+
+        //每个32位权重复制为两个16位，再按像素重排：低半为像素0~3，高半为像素4~7，每像素4个通道
+        const __m256i w16 = _mm256_or_si256(w32, _mm256_slli_epi32(w32, 16));
+        const __m256i wLow = _mm256_permutevar8x32_epi32(w16, lowPixels);
+        const __m256i wHigh = _mm256_permutevar8x32_epi32(w16, highPixels);
+        const __m256i sLow = _mm256_srli_epi16(_mm256_mullo_epi16(color16, wLow), 8);
+        const __m256i sHigh = _mm256_srli_epi16(_mm256_mullo_epi16(color16, wHigh), 8);
+
+        __m256i *address = reinterpret_cast<__m256i*>(line + x);
+        const __m256i dst = _mm256_loadu_si256(address);
+        __m256i out;
+        if(row.mode == Splat::Additive)
+        {
+            out = _mm256_adds_epu8(dst, _mm256_permute4x64_epi64(_mm256_packus_epi16(sLow, sHigh), 0xD8));
+        }
+        else
+        {
+            const __m256i dLow = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(dst));
+            const __m256i dHigh = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(dst, 1));
+            const __m256i aLow = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(sLow, 0xFF), 0xFF);
+            const __m256i aHigh = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(sHigh, 0xFF), 0xFF);
+            const __m256i oLow = _mm256_add_epi16(sLow, _mm256_srli_epi16(_mm256_mullo_epi16(dLow, _mm256_sub_epi16(full, aLow)), 8));
+            const __m256i oHigh = _mm256_add_epi16(sHigh, _mm256_srli_epi16(_mm256_mullo_epi16(dHigh, _mm256_sub_epi16(full, aHigh)), 8));
+            //打包按128位通道交错，重排回像素顺序
+            out = _mm256_permute4x64_epi64(_mm256_packus_epi16(oLow, oHigh), 0xD8);
+        }
+        _mm256_storeu_si256(address, out);
+    }
+    blendRowSse41(line, x, to, row);
+}
+#endif
+
+using RowFunction = void (*)(quint32 *line, int from, int to, const Row &row);
+
+RowFunction detectRowFunction()
+{
+#ifdef SPLAT_SSE41
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return blendRowAvx2;
+    }
+    if(__builtin_cpu_supports("sse4.1"))
+    {
+        return blendRowSse41;
+    }
+#endif
+    return blendRowScalar;
+}
+
+//内核按mode自行混合：painter为默认的源覆盖，或者已经设置为与mode相同的混合方式时才能代替QPainter
+bool supportsComposition(QPainter::CompositionMode composition, Splat::Mode mode)
+{
+    switch (mode) {
+    case Splat::Additive:
+        return composition == QPainter::CompositionMode_SourceOver || composition == QPainter::CompositionMode_Plus;
+    case Splat::Overlay:
+        return composition == QPainter::CompositionMode_SourceOver || composition == QPainter::CompositionMode_Overlay;
+    case Splat::Alpha:
+    default:
+        return composition == QPainter::CompositionMode_SourceOver;
+    }
+}
+
+RowFunction rowFunction()
+{
+    static const RowFunction function = detectRowFunction();
+    return function;
+}
+
+}
+
+void Splat::splat(uchar *bits, qsizetype bytesPerLine, const QRect &clip, const QPointF &center, qreal radius, QRgb premultiplied, Mode mode, qreal falloff)
+{
+    if(radius <= 0 || qAlpha(premultiplied) == 0)
+    {
+        return;
+    }
+    const QRect bounds = QRect(qFloor(center.x() - radius - 1), qFloor(center.y() - radius - 1),
+                               qCeil(2 * radius) + 3, qCeil(2 * radius) + 3).intersected(clip);
+    if(bounds.isEmpty())
+    {
+        return;
+    }
+
+    Row row;
+    row.cx = float(center.x());
+    row.radius = float(radius);
+    row.inverseRadius = float(1.0 / radius);
+    row.falloff = float(falloff);
+    row.color = premultiplied;
+    row.mode = mode;
+    const RowFunction function = rowFunction();
+    for (int y = bounds.top(); y <= bounds.bottom(); ++y) {
+        const float dy = float(y) + 0.5f - float(center.y());
+        row.dy2 = dy * dy;
+        if(row.dy2 > (row.radius + 0.5f) * (row.radius + 0.5f))
+        {
+            continue;
+        }
+        quint32 *line = reinterpret_cast<quint32*>(bits + y * bytesPerLine);
+        function(line, bounds.left(), bounds.right() + 1, row);
+    }
+}
+
+bool Splat::paint(QPainter *painter, const QRectF &rect, const QColor &color, Mode mode, qreal falloff)
+{
+    QPaintDevice *device = painter->device();
+    if(!device || device->devType() != QInternal::Image)
+    {
+        return false;
+    }
+    if(!supportsComposition(painter->compositionMode(), mode))
+    {
+        return false;
+    }
+    QImage *image = static_cast<QImage*>(device);
+    const QTransform transform = painter->deviceTransform();
+    if(image->format() != QImage::Format_ARGB32_Premultiplied || transform.type() > QTransform::TxScale)
+    {
+        return false;
+    }
+
+    QRect clip = image->rect();
+    if(painter->hasClipping())
+    {
+        const QRegion region = painter->clipRegion();
+        if(region.rectCount() > 1)
+        {
+            return false;
+        }
+        clip &= transform.mapRect(QRectF(region.boundingRect())).toAlignedRect();
+    }
+
+    QColor source = color;
+    source.setAlphaF(source.alphaF() * painter->opacity());
+    const QRectF target = transform.mapRect(rect);
+    splat(image->bits(), image->bytesPerLine(), clip, target.center(), target.width() / 2, qPremultiply(source.rgba()), mode, falloff);
+    return true;
+}
+
+bool Splat::simdEnabled()
+{
+    return rowFunction() != blendRowScalar;
+}
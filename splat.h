@@ -0,0 +1,31 @@
+#ifndef SPLAT_H
+#define SPLAT_H
+
+#include <QPainter>
+#include <QRect>
+#include <QRgb>
+
+//径向圆点光栅化
+//小粒子(几到几十像素)走QPainter::drawEllipse要经过通用路径光栅器，开销远大于像素本身，
+//这里直接在预乘ARGB32缓冲区上逐行混合，x86上运行时检测AVX2(每次8个像素)与SSE4.1(每次4个像素)，否则走标量实现(结果逐位一致)
+namespace Splat {
+
+    enum Mode {
+        Alpha,          //源覆盖(SourceOver)
+        Additive,       //相加(Plus)
+        Overlay         //叠加(Overlay)
+    };
+
+    //bits/bytesPerLine为ARGB32_Premultiplied缓冲区，clip为允许写入的像素范围，center/radius为像素坐标
+    //falloff为0时是实心圆(边缘1像素抗锯齿)，为1时强度从圆心线性衰减到边缘
+    void splat(uchar *bits, qsizetype bytesPerLine, const QRect &clip,
+               const QPointF &center, qreal radius, QRgb premultiplied, Mode mode, qreal falloff = 0);
+
+    //painter的目标是ARGB32_Premultiplied图像、只有平移缩放且混合方式为源覆盖(或与mode相同)时直接写入图像并返回true，
+    //否则返回false由调用者回退到QPainter
+    bool paint(QPainter *painter, const QRectF &rect, const QColor &color, Mode mode, qreal falloff = 0);
+
+    bool simdEnabled();
+}
+
+#endif // SPLAT_H
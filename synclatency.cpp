@@ -0,0 +1,139 @@
+#include "synclatency.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <algorithm>
+#include <cmath>
+
+//分桶上界(毫秒)，最后一个桶收纳其余
+static const qint64 bucketLimits[SYNC_BUCKET_COUNT - 1] = {0, 5, 10, 20, 50, 100, 200, 500, 1000};
+
+SyncLatency *SyncLatency::global()
+{
+    static SyncLatency latency;
+    return &latency;
+}
+
+void SyncLatency::eventExecuted(const QString &name, qint64 intended, qint64 executed)
+{
+    QMutexLocker locker(&m_mutex);
+    m_records.append({name, intended, executed});
+    m_pending++;
+}
+
+void SyncLatency::frameStarted(qint64 position, qint64 frame)
+{
+    QMutexLocker locker(&m_mutex);
+    for (int i = int(m_records.count()) - m_pending; i < m_records.count(); ++i) {
+        m_records[i].presented = position;
+        m_records[i].frame = frame;
+    }
+    m_pending = 0;
+}
+
+void SyncLatency::finishRun()
+{
+    const QJsonObject json = toJson();
+    {
+        QMutexLocker locker(&m_mutex);
+        m_records.clear();
+        m_pending = 0;
+    }
+    if(m_dumpFile.isEmpty())
+    {
+        return;
+    }
+
+    QFile file(m_dumpFile);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qDebug() << "无法写入同步延迟文件" << m_dumpFile;
+        return;
+    }
+    file.write(QJsonDocument(json).toJson(QJsonDocument::Compact));
+    file.write("\n");
+}
+
+QVector<SyncLatency::Record> SyncLatency::records() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_records;
+}
+
+//均值、最大值、分位数与直方图
+QJsonObject SyncLatency::summarize(QVector<qint64> latencies)
+{
+    QJsonObject json;
+    json["count"] = int(latencies.count());
+    if(latencies.isEmpty())
+    {
+        return json;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    qint64 total = 0;
+    int counts[SYNC_BUCKET_COUNT] = {};
+    for (qint64 latency : std::as_const(latencies)) {
+        total += latency;
+        counts[std::upper_bound(bucketLimits, bucketLimits + SYNC_BUCKET_COUNT - 1, latency) - bucketLimits]++;
+    }
+    auto percentile = [&latencies](double p) {
+        return latencies.at(std::clamp(int(std::ceil(p * latencies.count())) - 1, 0, int(latencies.count()) - 1));
+    };
+
+    //桶i覆盖[上界i-1, 上界i)，首桶为负延迟(提前)
+    QJsonArray histogram;
+    for (int i = 0; i < SYNC_BUCKET_COUNT; ++i) {
+        QJsonObject bucket;
+        if(i > 0)
+        {
+            bucket["from"] = bucketLimits[i - 1];
+        }
+        if(i < SYNC_BUCKET_COUNT - 1)
+        {
+            bucket["to"] = bucketLimits[i];
+        }
+        bucket["count"] = counts[i];
+        histogram.append(bucket);
+    }
+
+    json["mean"] = double(total) / latencies.count();
+    json["min"] = latencies.first();
+    json["max"] = latencies.last();
+    json["p50"] = percentile(0.50);
+    json["p95"] = percentile(0.95);
+    json["histogram"] = histogram;
+    return json;
+}
+
+//dispatch为事件执行相对预定时间的延迟，presentation为首个受影响的显示帧相对预定时间的延迟(毫秒)
+QJsonObject SyncLatency::toJson() const
+{
+    QMutexLocker locker(&m_mutex);
+    QJsonArray events;
+    QVector<qint64> dispatch;
+    QVector<qint64> presentation;
+    for (const Record &record : m_records) {
+        QJsonObject event;
+        event["name"] = record.name;
+        event["intended"] = record.intended;
+        event["executed"] = record.executed;
+        event["presented"] = record.presented;
+        event["frame"] = record.frame;
+        events.append(event);
+        dispatch.append(record.executed - record.intended);
+        if(record.presented >= 0)
+        {
+            presentation.append(record.presented - record.intended);
+        }
+    }
+
+    QJsonObject json;
+    json["time"] = QDateTime::currentMSecsSinceEpoch();
+    json["dispatch"] = summarize(dispatch);
+    json["presentation"] = summarize(presentation);
+    json["events"] = events;
+    return json;
+}
@@ -0,0 +1,46 @@
+#ifndef SYNCLATENCY_H
+#define SYNCLATENCY_H
+
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#define SYNC_BUCKET_COUNT 10            //延迟直方图分桶数(见synclatency.cpp中的分桶上界)
+
+//音画同步延迟：记录每个时间线事件的预定音乐时间、实际执行时的音乐时间，以及执行后第一个显示帧的音乐时间，
+//每场演出汇总为直方图与分位数，谢幕时向文件追加一行JSON
+//事件在时间线线程上报，显示帧在GUI线程上报
+class SyncLatency
+{
+public:
+    struct Record
+    {
+        QString name;
+        qint64 intended;        //预定音乐时间(毫秒)
+        qint64 executed;        //执行时的音乐时间(毫秒)
+        qint64 presented = -1;  //执行后第一个显示帧的音乐时间(毫秒)，尚未出帧时为-1
+        qint64 frame = -1;      //该显示帧的序号
+    };
+
+    static SyncLatency *global();
+
+    void setDumpFile(const QString &fileName){m_dumpFile = fileName;}
+    void eventExecuted(const QString &name, qint64 intended, qint64 executed);
+    void frameStarted(qint64 position, qint64 frame);       //显示帧开始：为之前执行的事件补上首帧
+    void finishRun();                                       //一场演出结束：设置了转储文件时追加一行，并清空记录
+
+    QVector<Record> records() const;
+    QJsonObject toJson() const;
+
+private:
+    SyncLatency() = default;
+    static QJsonObject summarize(QVector<qint64> latencies);
+
+    mutable QMutex m_mutex;
+    QVector<Record> m_records;
+    int m_pending = 0;                  //m_records末尾尚未出帧的记录数
+    QString m_dumpFile;
+};
+
+#endif // SYNCLATENCY_H
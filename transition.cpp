@@ -0,0 +1,165 @@
+#include "transition.h"
+#include "screenwriter.h"
+
+#include <QGraphicsRectItem>
+
+Transition::Transition(int duration, const QEasingCurve &easing)
+    : m_duration(std::max(0, duration))
+    , m_easing(easing)
+{
+}
+
+bool Transition::advance(qreal msecs)
+{
+    m_elapsed += msecs;
+    const qreal progress = m_duration > 0 ? std::min<qreal>(m_elapsed / m_duration, 1.0) : 1.0;
+    apply(m_easing.valueForProgress(progress));
+    return progress >= 1.0;
+}
+
+//-------------------------------------------------------------------------------------------
+
+ColorRamp::ColorRamp(QGraphicsScene *scene, const QColor &from, const QColor &to, int duration, const QEasingCurve &easing)
+    : Transition(duration, easing)
+    , m_scene(scene)
+    , m_from(from)
+    , m_to(to)
+{
+}
+
+void ColorRamp::apply(qreal progress)
+{
+    m_scene->setBackgroundBrush(QColor::fromRgbF(
+        m_from.redF()   + (m_to.redF()   - m_from.redF())   * progress,
+        m_from.greenF() + (m_to.greenF() - m_from.greenF()) * progress,
+        m_from.blueF()  + (m_to.blueF()  - m_from.blueF())  * progress,
+        m_from.alphaF() + (m_to.alphaF() - m_from.alphaF()) * progress));
+}
+
+OpacityRamp::OpacityRamp(QGraphicsObject *item, qreal from, qreal to, int duration, const QEasingCurve &easing)
+    : Transition(duration, easing)
+    , m_item(item)
+    , m_from(from)
+    , m_to(to)
+{
+}
+
+void OpacityRamp::apply(qreal progress)
+{
+    if(m_item)
+    {
+        m_item->setOpacity(m_from + (m_to - m_from) * progress);
+    }
+}
+
+WriterFade::WriterFade(Screenwriter *screenwriter, qreal from, qreal to, int duration, const QEasingCurve &easing)
+    : Transition(duration, easing)
+    , m_screenwriter(screenwriter)
+    , m_from(from)
+    , m_to(to)
+{
+}
+
+void WriterFade::apply(qreal progress)
+{
+    if(m_screenwriter)
+    {
+        m_screenwriter->setOpacity(m_from + (m_to - m_from) * progress);
+    }
+}
+
+Wipe::Wipe(QGraphicsScene *scene, const QColor &color, Qt::Edge edge, int duration, const QEasingCurve &easing)
+    : Transition(duration, easing)
+    , m_scene(scene)
+    , m_color(color)
+    , m_edge(edge)
+{
+}
+
+Wipe::~Wipe()
+{
+    delete m_item;
+}
+
+void Wipe::apply(qreal progress)
+{
+    if(progress >= 1.0)
+    {
+        m_scene->setBackgroundBrush(m_color);
+        delete m_item;
+        m_item = nullptr;
+        return;
+    }
+    if(!m_item)
+    {
+        m_item = new QGraphicsRectItem();
+        m_item->setPen(Qt::NoPen);
+        m_item->setBrush(m_color);
+        m_item->setZValue(-2);                      //位于背景图之下、背景色之上
+        m_scene->addItem(m_item);
+    }
+
+    QRectF rect = m_scene->sceneRect();
+    switch (m_edge) {
+    case Qt::LeftEdge:
+        rect.setWidth(rect.width() * progress);
+        break;
+    case Qt::RightEdge:
+        rect.setLeft(rect.right() - rect.width() * progress);
+        break;
+    case Qt::TopEdge:
+        rect.setHeight(rect.height() * progress);
+        break;
+    case Qt::BottomEdge:
+        rect.setTop(rect.bottom() - rect.height() * progress);
+        break;
+    }
+    m_item->setRect(rect);
+}
+
+//-------------------------------------------------------------------------------------------
+
+Transitions::~Transitions()
+{
+    clear();
+}
+
+void Transitions::add(Transition *transition)
+{
+    QMutexLocker locker(&m_mutex);
+    m_transitions.append(transition);
+}
+
+void Transitions::crossFade(Screenwriter *from, Screenwriter *to, int duration)
+{
+    add(new WriterFade(from, 1.0, 0.0, duration));
+    add(new WriterFade(to, 0.0, 1.0, duration));
+}
+
+void Transitions::advance(qreal msecs)
+{
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < m_transitions.count();) {
+        if(m_transitions.at(i)->advance(msecs))
+        {
+            delete m_transitions.takeAt(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+void Transitions::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    qDeleteAll(m_transitions);
+    m_transitions.clear();
+}
+
+bool Transitions::isEmpty() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_transitions.isEmpty();
+}
@@ -0,0 +1,112 @@
+#ifndef TRANSITION_H
+#define TRANSITION_H
+
+#include <QColor>
+#include <QEasingCurve>
+#include <QGraphicsObject>
+#include <QGraphicsScene>
+#include <QList>
+#include <QMutex>
+#include <QPointer>
+
+class Screenwriter;
+class QGraphicsRectItem;
+
+//过渡：每个显示帧按实际经过的时间推进，进度经缓动曲线后交给apply，不阻塞任何线程
+class Transition
+{
+public:
+    explicit Transition(int duration, const QEasingCurve &easing = QEasingCurve::Linear);
+    virtual ~Transition(){}
+
+    bool advance(qreal msecs);                      //推进并应用，已应用终值时返回true
+
+protected:
+    virtual void apply(qreal progress) = 0;         //progress为缓动后的进度[0,1]
+
+private:
+    int m_duration;
+    qreal m_elapsed = 0;
+    QEasingCurve m_easing;
+};
+
+//场景背景色渐变
+class ColorRamp : public Transition
+{
+public:
+    ColorRamp(QGraphicsScene *scene, const QColor &from, const QColor &to, int duration, const QEasingCurve &easing = QEasingCurve::Linear);
+
+protected:
+    void apply(qreal progress) override;
+
+private:
+    QGraphicsScene *m_scene;
+    QColor m_from;
+    QColor m_to;
+};
+
+//图元透明度渐变(代替QPropertyAnimation)
+class OpacityRamp : public Transition
+{
+public:
+    OpacityRamp(QGraphicsObject *item, qreal from, qreal to, int duration, const QEasingCurve &easing = QEasingCurve::Linear);
+
+protected:
+    void apply(qreal progress) override;
+
+private:
+    QPointer<QGraphicsObject> m_item;
+    qreal m_from;
+    qreal m_to;
+};
+
+//编剧整体透明度渐变，两个反向的渐变组成交叉淡入淡出
+class WriterFade : public Transition
+{
+public:
+    WriterFade(Screenwriter *screenwriter, qreal from, qreal to, int duration, const QEasingCurve &easing = QEasingCurve::Linear);
+
+protected:
+    void apply(qreal progress) override;
+
+private:
+    QPointer<Screenwriter> m_screenwriter;
+    qreal m_from;
+    qreal m_to;
+};
+
+//擦除：新背景色从edge一侧扫过整个场景，结束后成为场景背景色
+class Wipe : public Transition
+{
+public:
+    Wipe(QGraphicsScene *scene, const QColor &color, Qt::Edge edge, int duration, const QEasingCurve &easing = QEasingCurve::InOutQuad);
+    ~Wipe();
+
+protected:
+    void apply(qreal progress) override;
+
+private:
+    QGraphicsScene *m_scene;
+    QColor m_color;
+    Qt::Edge m_edge;
+    QGraphicsRectItem *m_item = nullptr;            //在GUI线程首次推进时创建
+};
+
+//过渡集合：可在任意线程添加，由显示帧(GUI线程)统一推进；多个过渡同时生效，按添加顺序应用
+class Transitions
+{
+public:
+    ~Transitions();
+
+    void add(Transition *transition);               //取得所有权
+    void crossFade(Screenwriter *from, Screenwriter *to, int duration);
+    void advance(qreal msecs);
+    void clear();
+    bool isEmpty() const;
+
+private:
+    mutable QMutex m_mutex;
+    QList<Transition*> m_transitions;
+};
+
+#endif // TRANSITION_H
@@ -0,0 +1,42 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+//三缓冲：一个生产者写后台缓冲，一个消费者读前台缓冲，中间缓冲保存最近一次发布的内容
+//交换只是一次原子交换下标，不复制数据、不加锁；消费者总能拿到最新发布的内容，生产者从不等待消费者
+template<typename T>
+class TripleBuffer
+{
+public:
+    T &back(){return m_slots[m_back];}                  //生产者：写入后调用publish
+    const T &front() const {return m_slots[m_front];}   //消费者：先调用update
+    T &slot(int index){return m_slots[index];}          //生产者与消费者都已停止时访问任一缓冲(例如释放)
+
+    //生产者：发布后台缓冲，换回中间缓冲作为新的后台缓冲
+    void publish()
+    {
+        m_back = m_middle.exchange(m_back | Fresh, std::memory_order_acq_rel) & Index;
+    }
+
+    //消费者：有新发布的内容时与前台缓冲交换，返回是否更新
+    bool update()
+    {
+        if(!(m_middle.load(std::memory_order_acquire) & Fresh))
+        {
+            return false;
+        }
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & Index;
+        return true;
+    }
+
+private:
+    enum {Index = 3, Fresh = 4};
+
+    T m_slots[3];
+    int m_back = 0;
+    int m_front = 1;
+    std::atomic<int> m_middle{2};
+};
+
+#endif // TRIPLEBUFFER_H